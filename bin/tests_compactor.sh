@@ -58,6 +58,46 @@ printf "\n%s%s\n" "$prompt" "$command"
 $command
 printf "\n"
 
+# A source of more than two chunks (1 MiB each), compacted with threads, has to
+# give what it gives without them.
+large_file="programs/compactor_large_file.bx"
+parallel_file="programs/compactor_parallel_file.bx"
+cp programs/addition.bx "$large_file"
+for i in 1 2 3 4 5 6 7 8 9 10 11; do
+    cat "$large_file" "$large_file" > "$test_file"
+    mv "$test_file" "$large_file"
+done
+command="$executable -q $large_file $test_file"
+printf "\n\n\n%s\n\n%s%s\n" "$separator" "$prompt" "$command"
+$command
+command="$executable -q -t 4 $large_file $parallel_file"
+printf "%s%s\n" "$prompt" "$command"
+$command
+command="cmp $test_file $parallel_file"
+printf "%s%s\n\n" "$prompt" "$command"
+$command && printf "Same output.\n"
+rm "$large_file" "$parallel_file"
+
+# The program rewritten with -o has to print what the one compacted without it
+# does.
+optimized_file="programs/compactor_optimized_file.bx"
+command="$executable -q programs/addition.bx $test_file"
+printf "\n\n\n%s\n\n%s%s\n" "$separator" "$prompt" "$command"
+$command
+command="$executable -q -o programs/addition.bx $optimized_file"
+printf "%s%s\n" "$prompt" "$command"
+$command
+command="./boolx $test_file"
+printf "%s%s\n\n" "$prompt" "$command"
+$command | tee "$test_file.out"
+command="./boolx $optimized_file"
+printf "\n%s%s\n\n" "$prompt" "$command"
+$command | tee "$optimized_file.out"
+command="cmp $test_file.out $optimized_file.out"
+printf "\n%s%s\n\n" "$prompt" "$command"
+$command && printf "Same output.\n"
+rm "$optimized_file" "$test_file.out" "$optimized_file.out"
+
 # etc.
 
 if test -f "$test_file"; then # file exists
@@ -28,6 +28,69 @@ command="$executable programs/hello_world.bx"
 printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
 $command
 
+command="$executable -j programs/hello_world.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -r programs/hello_world.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -a programs/hello_world.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -j programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -r programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -n programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -m 1 programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable --max_call_depth 100 programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable programs/seek_bits.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -r programs/seek_bits.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+command="$executable -j programs/seek_bits.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+input_file="programs/input_test_file.txt"
+output_file="programs/output_test_file.txt"
+printf "a" > "$input_file"
+command="$executable -i $input_file -o $output_file \
+programs/next_ASCII_char.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+command="cat $output_file"
+printf "%s%s\n\n" "$prompt" "$command"
+$command
+command="$executable -j -i $input_file programs/next_ASCII_char.bx"
+printf "\n\n%s%s\n\n" "$prompt" "$command"
+$command
+rm "$input_file" "$output_file"
+
 # command="$executable -d programs/hello_world.bx"
 # printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
 # $command
@@ -36,6 +99,41 @@ $command
 # printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
 # $command
 
+command="$executable -s programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+
+profile_file="programs/profile_test_file.txt"
+command="$executable -p $profile_file programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s\n\n" "$separator" "$prompt" "$command"
+$command
+command="cat $profile_file"
+printf "\n%s%s\n\n" "$prompt" "$command"
+$command
+command="cat $profile_file.folded"
+printf "\n%s%s\n\n" "$prompt" "$command"
+$command
+rm "$profile_file" "$profile_file.folded"
+
+# The program translated to C, and compiled with the runtime, has to print
+# what the interpreter does.
+translated_program="programs/translated_program"
+command="$executable -c programs/addition.bx"
+printf "\n\n\n%s\n\n%s%s > %s.c\n\n" "$separator" "$prompt" "$command" \
+    "$translated_program"
+$command > "$translated_program.c"
+command="cc -O2 -I ../src -o $translated_program $translated_program.c \
+../src/runtime.c ../src/core.c -lpthread"
+printf "%s%s\n\n" "$prompt" "$command"
+$command
+command="$translated_program"
+printf "%s%s\n\n" "$prompt" "$command"
+$command
+command="$executable programs/addition.bx"
+printf "\n\n%s%s\n\n" "$prompt" "$command"
+$command
+rm "$translated_program.c" "$translated_program"
+
 # etc.
 
 printf "\n\n\n\n"
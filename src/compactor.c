@@ -6,39 +6,103 @@
  * Distributed under the MIT License, see "license.txt"
  */
 
+#define _DEFAULT_SOURCE // madvise
+
+#include "tokenizer.h"
+
 #include <ctype.h> // isprint
+#include <errno.h> // errno
+#include <fcntl.h> // open
 #include <getopt.h>
-#include <stdbool.h> // bool
-#include <stdio.h>   // printf, file stuff
-#include <stdlib.h>  // abort
+#include <pthread.h>  // pthread_create
+#include <stdbool.h>  // bool
+#include <stdio.h>    // printf, file stuff
+#include <stdlib.h>   // abort, malloc
+#include <string.h>   // memcpy, strchr, strcmp
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read, write, close, isatty
 
 #define LINES_LENGTH_DEFAULT 36
+#define SOURCE_BUFFER_SIZE 65536
+#define OUTPUT_BUFFER_SIZE 65536
+/* The smallest part of the source worth a thread of its own. */
+#define MIN_CHUNK_LENGTH (1 << 20)
+
+/* A part of the source compacted by a thread of its own. */
+struct TChunk {
+	const char *source;
+	long long int length;
+
+	/* How much deeper in comments the chunk ends than it starts. */
+	long long int depth_delta;
+	long long int start_depth;
+
+	char *instructions;
+	long long int n_instructions;
+};
 
 static bool show_usage = false;
 static char *source_program_path;
 static char *output_program_path;
 static long int lines_length = LINES_LENGTH_DEFAULT;
 static long long int n_nested_comments = 0;
+static long int char_line_counter = 0;
+static bool quiet = false;
+static long int n_threads = 1;
+
+/* With "-o" the whole program is kept here, and only written once
+ * optimized. */
+static bool optimize = false;
+static char *program = NULL;
+static long long int program_length = 0;
+static long long int program_capacity = 0;
+
+/* The compacted program, written to "output_fd" in blocks; unless quiet, the
+ * same blocks are echoed on the terminal. */
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static long long int output_length = 0;
+static int output_fd = STDOUT_FILENO;
+static bool echo = false;
 
 static int
 process_arguments(int argc, char *argv[])
 {
 	char *lines_length_arg = NULL;
+	char *n_threads_arg = NULL;
+	char *end;
 	int c;
 	opterr = 0;
 	int non_option_argc;
 
 	static struct option long_options[] = {
-	    {"lines_length", required_argument, NULL, 'l'}, {NULL, 0, NULL, 0}};
+	    {"lines_length", required_argument, NULL, 'l'},
+	    {"optimize", no_argument, NULL, 'o'},
+	    {"quiet", no_argument, NULL, 'q'},
+	    {"threads", required_argument, NULL, 't'},
+	    {NULL, 0, NULL, 0}};
 
-	while ((c = getopt_long(argc, argv, "l:", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "l:oqt:", long_options, NULL)) !=
+	       -1) {
 		switch (c) {
 		case 'l': {
 			lines_length_arg = optarg;
 			break;
 		}
+		case 'o': {
+			optimize = true;
+			break;
+		}
+		case 'q': {
+			quiet = true;
+			break;
+		}
+		case 't': {
+			n_threads_arg = optarg;
+			break;
+		}
 		case '?': {
-			if (optopt == 'l') {
+			if (optopt == 'l' || optopt == 't') {
 				fprintf(
 				    stderr,
 				    "Option -%c requires an argument.\n",
@@ -69,81 +133,480 @@ process_arguments(int argc, char *argv[])
 		}
 	}
 
+	if (n_threads_arg != NULL) {
+		n_threads = strtol(n_threads_arg, &end, 10);
+		if (*end != '\0' || end == n_threads_arg || n_threads < 1) {
+			fprintf(
+			    stderr,
+			    "Option '-t' has been given a bad value.\n");
+			return 1;
+		}
+	}
+
 	non_option_argc = argc - optind;
 
 	if (non_option_argc == 0) {
 		show_usage = true;
 		return 0;
 	} else if (non_option_argc == 1) {
-		printf("Missing output file.\n");
+		fprintf(stderr, "Missing output file.\n");
 		return 1;
 	} else if (non_option_argc == 2) {
 		source_program_path = argv[optind];
 		output_program_path = argv[optind + 1];
 		return 0;
 	} else {
-		printf("Too many arguments.\n");
+		fprintf(stderr, "Too many arguments.\n");
 		return 1;
 	}
 }
 
 static bool
-is_instruction_to_be_included(char current_instruction)
+write_all(int fd, const char *bytes, long long int length)
+{
+	long long int written = 0;
+	ssize_t n;
+
+	while (written < length) {
+		n = write(fd, bytes + written, length - written);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			return false;
+		}
+		written += n;
+	}
+	return true;
+}
+
+static bool
+flush_output()
+{
+	if (write_all(output_fd, output_buffer, output_length) == false) {
+		fprintf(stderr, "Error while writing to the output file.\n");
+		return false;
+	}
+	if (echo) {
+		write_all(STDOUT_FILENO, output_buffer, output_length);
+	}
+	output_length = 0;
+	return true;
+}
+
+static bool
+output_bytes(const char *bytes, long long int length)
+{
+	long long int n;
+
+	while (length > 0) {
+		if (output_length == OUTPUT_BUFFER_SIZE &&
+		    flush_output() == false) {
+			return false;
+		}
+		n = OUTPUT_BUFFER_SIZE - output_length;
+		if (n > length) {
+			n = length;
+		}
+		memcpy(output_buffer + output_length, bytes, n);
+		output_length += n;
+		bytes += n;
+		length -= n;
+	}
+	return true;
+}
+
+/* Output the "length" instructions at "instructions", split in lines of
+ * "lines_length" characters. */
+static bool
+output_lines(const char *instructions, long long int length)
+{
+	long long int n;
+
+	while (length > 0) {
+		n = lines_length - char_line_counter;
+		if (lines_length <= 0 || n > length) {
+			n = length;
+		}
+		if (output_bytes(instructions, n) == false) {
+			return false;
+		}
+		instructions += n;
+		length -= n;
+		char_line_counter += n;
+
+		if (char_line_counter == lines_length) {
+			if (output_bytes("\n", 1) == false) {
+				return false;
+			}
+			char_line_counter = 0;
+		}
+	}
+	return true;
+}
+
+/* Output the instructions, or keep them for later if the program is to be
+ * optimized. */
+static bool
+pass_instructions(const char *instructions, long long int length)
 {
-	switch (current_instruction) {
-	case '>':
-		return true;
+	if (optimize == false) {
+		return output_lines(instructions, length);
+	}
+
+	if (program_length + length > program_capacity) {
+		while (program_length + length > program_capacity) {
+			program_capacity = program_capacity == 0
+					       ? SOURCE_BUFFER_SIZE
+					       : program_capacity * 2;
+		}
+		program = realloc(program, program_capacity);
+	}
+	memcpy(program + program_length, instructions, length);
+	program_length += length;
+	return true;
+}
+
+/* Whether the last of the first "length" instructions of "program" is one of
+ * "instructions". */
+static bool
+follows(long long int length, const char *instructions)
+{
+	return length > 0 && strchr(instructions, program[length - 1]) != NULL;
+}
+
+/* Append "instruction" to the first "length" instructions of "program", and
+ * return the new length; the instructions before it that make no difference
+ * are dropped on the way, and so is the instruction itself, if it makes
+ * none. Nothing can jump in between two instructions that end up next to each
+ * other, since labels are never dropped and neither are if-else statements,
+ * so the rewrites only need to hold for straight code. */
+static long long int
+append_optimized_instruction(long long int length, char instruction)
+{
+	switch (instruction) {
 	case '<':
-		return true;
-	case '|':
-		return true;
-	case '+':
-		return true;
+		/* Always back where it was; the other way round it isn't, on
+		 * the first cell. */
+		if (follows(length, ">")) {
+			return length - 1;
+		}
+		break;
 	case '-':
-		return true;
+		/* Moving past a null bit makes it 0, so only the bit just set
+		 * is known to be left as it was. */
+		if (follows(length, "+") && follows(length - 1, "_^")) {
+			return length - 1;
+		}
+		break;
 	case '=':
-		return true;
+		if (follows(length, "%&=")) {
+			return length;
+		}
+		break;
 	case '_':
-		return true;
 	case '^':
-		return true;
+		/* The bit is overwritten. */
+		while (follows(length, "_^")) {
+			length--;
+		}
+		break;
 	case '*':
-		return true;
+		while (follows(length, "_^")) {
+			length--;
+		}
+		/* The bits are already null. */
+		if (follows(length, "%*")) {
+			return length;
+		}
+		break;
 	case '%':
-		return true;
-	case ']':
-		return true;
-	case '[':
-		return true;
-	case '#':
-		return true;
-	case '&':
-		return true;
-	case '?':
-		return true;
-	case '"':
-		return true;
-	case '!':
-		return true;
-	case ';':
-		return true;
-	case ':':
-		return true;
-	case '/':
-		return true;
-	case '\\':
-		return true;
-	case '$':
-		return true;
-	case '\'':
-		return true;
-	case '@':
-		return true;
-	case '~':
-		return true;
-	default:
-		return false;
+		/* Nothing done to the bits of the cell, or to which one is
+		 * selected, is left. */
+		while (follows(length, "_^*%=+-")) {
+			length--;
+		}
+		break;
 	}
+
+	program[length] = instruction;
+	return length + 1;
+}
+
+/* Rewrite "program" into an equivalent one that does less, in place; the
+ * labels are all kept, in the same order. Besides the rewrites of
+ * "append_optimized_instruction", the code after a '~' outside of every
+ * if-else statement is dropped up to the next label, as nothing else can get
+ * there; that is, as long as its if-else statements are complete, since the
+ * ones after it are told apart as if it was there. */
+static void
+optimize_program()
+{
+	long long int length = 0;
+	/* The nesting of if-else statements as the interpreter sees it. */
+	long long int depth = 0;
+	long long int dead_code_start = -1;
+	long long int dead_code_depth = 0;
+	bool dead_code_complete = true;
+	char instruction;
+
+	for (long long int i = 0; i < program_length; i++) {
+		instruction = program[i];
+		if (instruction == ':' && dead_code_start >= 0) {
+			if (dead_code_complete && dead_code_depth == 0) {
+				length = dead_code_start;
+			}
+			dead_code_start = -1;
+		}
+
+		if (instruction == '?' || instruction == '"') {
+			depth++;
+			dead_code_depth++;
+		} else if (instruction == ';' || instruction == '!') {
+			if (dead_code_depth == 0) {
+				dead_code_complete = false;
+			} else if (instruction == ';') {
+				dead_code_depth--;
+			}
+			if (instruction == ';' && depth > 0) {
+				depth--;
+			}
+		}
+
+		length = append_optimized_instruction(length, instruction);
+
+		if (instruction == '~' && depth == 0 && dead_code_start < 0) {
+			dead_code_start = length;
+			dead_code_depth = 0;
+			dead_code_complete = true;
+		}
+	}
+	if (dead_code_start >= 0 && dead_code_complete &&
+	    dead_code_depth == 0) {
+		length = dead_code_start;
+	}
+
+	program_length = length;
+}
+
+/* Copy the instructions among the "length" characters at "source" to
+ * "instructions", leaving out the comments; "*depth" is how deep in comments
+ * the characters start, and is updated. Returns how many were copied. */
+static long long int
+filter_instructions(
+    const char *source, long long int length, long long int *depth,
+    char *instructions)
+{
+	struct TTokens tokens;
+	uint64_t wanted;
+	long long int n_instructions = 0;
+	long long int n;
+	long long int i;
+
+	for (long long int start = 0; start < length;
+	     start += TOKENIZER_BLOCK_SIZE) {
+		n = length - start < TOKENIZER_BLOCK_SIZE
+			? length - start
+			: TOKENIZER_BLOCK_SIZE;
+		tokenize_block(source + start, n, &tokens);
+		wanted = tokens.comment_starts | tokens.comment_ends;
+		if (wanted == 0 && *depth > 0) {
+			continue;
+		}
+
+		wanted |= tokens.instructions;
+		while (wanted != 0) {
+			i = next_token(&wanted);
+			if (tokens.comment_starts >> i & 1) {
+				(*depth)++;
+			} else if (tokens.comment_ends >> i & 1) {
+				(*depth)--;
+			} else if (*depth <= 0) {
+				instructions[n_instructions++] =
+				    source[start + i];
+			}
+		}
+	}
+	return n_instructions;
+}
+
+/* Compact the "length" characters at "source", a block at a time; returns
+ * false on a writing error. */
+static bool
+compact_source(const char *source, long long int length)
+{
+	static char instructions[SOURCE_BUFFER_SIZE];
+	long long int n_instructions;
+	long long int n;
+
+	for (long long int start = 0; start < length;
+	     start += SOURCE_BUFFER_SIZE) {
+		n = length - start < SOURCE_BUFFER_SIZE ? length - start
+							 : SOURCE_BUFFER_SIZE;
+		n_instructions = filter_instructions(
+		    source + start, n, &n_nested_comments, instructions);
+		if (pass_instructions(instructions, n_instructions) == false) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* The comments are the only thing that carries over from a chunk to the
+ * next one, and their depth is just the number of "{" minus the number of
+ * "}" so far: each chunk counts its own, and the sums give where every chunk
+ * starts. */
+static void *
+measure_chunk_depth(void *chunk_pointer)
+{
+	struct TChunk *chunk = chunk_pointer;
+	struct TTokens tokens;
+	long long int n;
+
+	chunk->depth_delta = 0;
+	for (long long int start = 0; start < chunk->length;
+	     start += TOKENIZER_BLOCK_SIZE) {
+		n = chunk->length - start < TOKENIZER_BLOCK_SIZE
+			? chunk->length - start
+			: TOKENIZER_BLOCK_SIZE;
+		tokenize_block(chunk->source + start, n, &tokens);
+		chunk->depth_delta += count_tokens(tokens.comment_starts) -
+				      count_tokens(tokens.comment_ends);
+	}
+	return NULL;
+}
+
+static void *
+filter_chunk(void *chunk_pointer)
+{
+	struct TChunk *chunk = chunk_pointer;
+	long long int depth = chunk->start_depth;
+
+	chunk->instructions = malloc(chunk->length);
+	chunk->n_instructions = filter_instructions(
+	    chunk->source, chunk->length, &depth, chunk->instructions);
+	return NULL;
+}
+
+/* Run "function" on every chunk, each in a thread of its own but the first
+ * one, which runs in this thread. */
+static void
+run_on_chunks(
+    void *(*function)(void *), struct TChunk *chunks, long int n_chunks)
+{
+	pthread_t *threads = malloc(n_chunks * sizeof(pthread_t));
+	bool *started = malloc(n_chunks * sizeof(bool));
+
+	for (long int i = 1; i < n_chunks; i++) {
+		started[i] =
+		    pthread_create(&threads[i], NULL, function, &chunks[i]) ==
+		    0;
+		if (started[i] == false) {
+			function(&chunks[i]);
+		}
+	}
+	function(&chunks[0]);
+	for (long int i = 1; i < n_chunks; i++) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	free(started);
+	free(threads);
+}
+
+/* Same as "compact_source", with the whole source split in chunks filtered
+ * in parallel; the lines are then made and written in order as usual. */
+static bool
+compact_source_in_parallel(const char *source, long long int length)
+{
+	long int n_chunks = n_threads;
+	struct TChunk *chunks;
+	long long int chunk_length;
+	long long int depth = n_nested_comments;
+	bool done = true;
+
+	if (length / MIN_CHUNK_LENGTH < n_chunks) {
+		n_chunks = length / MIN_CHUNK_LENGTH;
+	}
+	if (n_chunks <= 1) {
+		return compact_source(source, length);
+	}
+
+	chunks = malloc(n_chunks * sizeof(struct TChunk));
+	chunk_length = length / n_chunks;
+	for (long int i = 0; i < n_chunks; i++) {
+		chunks[i].source = source + i * chunk_length;
+		chunks[i].length = i == n_chunks - 1
+				       ? length - i * chunk_length
+				       : chunk_length;
+	}
+
+	run_on_chunks(measure_chunk_depth, chunks, n_chunks);
+	for (long int i = 0; i < n_chunks; i++) {
+		chunks[i].start_depth = depth;
+		depth += chunks[i].depth_delta;
+	}
+	n_nested_comments = depth;
+
+	run_on_chunks(filter_chunk, chunks, n_chunks);
+	for (long int i = 0; i < n_chunks; i++) {
+		if (done) {
+			done = pass_instructions(
+			    chunks[i].instructions, chunks[i].n_instructions);
+		}
+		free(chunks[i].instructions);
+	}
+
+	free(chunks);
+	return done;
+}
+
+/* A regular file is mapped in memory and compacted straight from there;
+ * anything else is read in blocks. Returns false on an error. */
+static bool
+compact_source_program(int source_program)
+{
+	static char buffer[SOURCE_BUFFER_SIZE];
+	struct stat source_stat;
+	char *source = MAP_FAILED;
+	ssize_t n_read;
+	bool done;
+
+	if (fstat(source_program, &source_stat) == 0 &&
+	    S_ISREG(source_stat.st_mode) && source_stat.st_size > 0) {
+		source = mmap(
+		    NULL, source_stat.st_size, PROT_READ, MAP_PRIVATE,
+		    source_program, 0);
+	}
+
+	if (source != MAP_FAILED && n_threads > 1) {
+		madvise(source, source_stat.st_size, MADV_WILLNEED);
+		done = compact_source_in_parallel(source, source_stat.st_size);
+		munmap(source, source_stat.st_size);
+		return done;
+	} else if (source != MAP_FAILED) {
+		madvise(source, source_stat.st_size, MADV_SEQUENTIAL);
+		done = compact_source(source, source_stat.st_size);
+		munmap(source, source_stat.st_size);
+		return done;
+	}
+
+	while ((n_read = read(source_program, buffer, SOURCE_BUFFER_SIZE)) !=
+	       0) {
+		if (n_read < 0 && errno == EINTR) {
+			continue;
+		} else if (n_read < 0) {
+			fprintf(
+			    stderr,
+			    "Error while reading the source program file.\n");
+			return false;
+		}
+		if (compact_source(buffer, n_read) == false) {
+			return false;
+		}
+	}
+	return true;
 }
 
 static void
@@ -155,22 +618,27 @@ print_usage()
 	       "<source_file>\n"
 	       "and save the result to <output_file>, with the goal of "
 	       "creating an\n"
-	       "artistic and esoteric source code.\n");
+	       "artistic and esoteric source code. Either file can be "
+	       "\"-\", meaning the\n"
+	       "standard input or output.\n");
 	printf(
 	    "  -l N                  set the max number of characters in "
 	    "each line to N\n"
 	    "                          (default is %d)\n",
 	    LINES_LENGTH_DEFAULT);
+	printf("  -o                    rewrite the program into an "
+	       "equivalent faster one\n");
+	printf("  -q                    don't show the result on the "
+	       "terminal\n");
+	printf("  -t N                  compact a large source file with N "
+	       "threads\n");
 }
 
 int
 main(int argc, char *argv[])
 {
-	FILE *source_program;
-	FILE *output_file;
-	char current_instruction;
-	bool writing_error = false;
-	long int char_line_counter = 0;
+	int source_program = STDIN_FILENO;
+	bool done;
 
 	if (process_arguments(argc, argv) != 0) {
 		return 1;
@@ -181,53 +649,48 @@ main(int argc, char *argv[])
 		return 0;
 	}
 
-	source_program = fopen(source_program_path, "r");
-	if (source_program == NULL) {
-		printf("Can't open the source program file.\n");
-		return 1;
-	}
-
-	output_file = fopen(output_program_path, "w");
-	if (output_file == NULL) {
-		printf("Can't open the output file.\n");
-		return 1;
+	if (strcmp(source_program_path, "-") != 0) {
+		source_program = open(source_program_path, O_RDONLY);
+		if (source_program < 0) {
+			fprintf(
+			    stderr, "Can't open the source program file.\n");
+			return 1;
+		}
 	}
 
-	/* Read the instructions one by one. */
-	while (fscanf(source_program, "%1c", &current_instruction) == 1) {
-		if (current_instruction == '{') {
-			n_nested_comments++;
-			continue;
-		} else if (current_instruction == '}') {
-			n_nested_comments--;
-			continue;
-		}
-		if (n_nested_comments > 0) {
-			continue;
+	if (strcmp(output_program_path, "-") != 0) {
+		output_fd = open(
+		    output_program_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (output_fd < 0) {
+			fprintf(stderr, "Can't open the output file.\n");
+			return 1;
 		}
 
-		if (is_instruction_to_be_included(current_instruction)) {
-			if (putc(current_instruction, output_file) == EOF) {
-				printf("Error while writing to the output "
-				       "file.\n");
-				writing_error = true;
-				break;
-			}
-			printf("%c", current_instruction);
-			char_line_counter++;
-			if (char_line_counter == lines_length) {
-				putc('\n', output_file);
-				printf("\n");
-				char_line_counter = 0;
-			}
-		}
+		/* Only a person is going to look at it. */
+		echo = quiet == false && isatty(STDOUT_FILENO);
 	}
-	if (writing_error == false) {
+
+	done = compact_source_program(source_program);
+	if (done && optimize) {
+		optimize_program();
+		done = output_lines(program, program_length);
+	}
+	done = done && flush_output();
+	free(program);
+	if (done && echo) {
 		printf("\nDone.\n");
 	}
 
-	fclose(output_file);
-	fclose(source_program);
+	if (output_fd != STDOUT_FILENO) {
+		close(output_fd);
+	}
+	if (source_program != STDIN_FILENO) {
+		close(source_program);
+	}
 
-	return 0;
+	if (done) {
+		return 0;
+	} else {
+		return 1;
+	}
 }
@@ -0,0 +1,861 @@
+/*
+ * core.c
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+#define _DEFAULT_SOURCE // madvise
+
+#include "core.h"
+
+#include <errno.h>    // errno
+#include <stdio.h>    // fprintf, getchar
+#include <stdlib.h>   // malloc
+#include <string.h>   // memcpy, memset
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read, write
+
+/* With "bx_async_output" the output is written by a thread of its own, which
+ * needs GCC's atomic builtins and POSIX threads; compile with
+ * -DNO_ASYNC_OUTPUT to leave it out, in which case it's written as usual. */
+#if defined(__GNUC__) && defined(__unix__) && !defined(NO_ASYNC_OUTPUT)
+#define USE_ASYNC_OUTPUT
+#include <pthread.h> // pthread_create
+#endif
+
+#define OUTPUT_BUFFER_SIZE 65536
+#define INPUT_BUFFER_SIZE 65536
+#define OUTPUT_RING_SIZE (16 * OUTPUT_BUFFER_SIZE)
+
+static void count_bits_in_queue(long long int change);
+static bool read_input(char *byte);
+static void write_output(const char *bytes, long long int length);
+#ifdef USE_ASYNC_OUTPUT
+static void *run_output_writer(void *unused);
+static long long int wait_for_output(long long int tail);
+static void push_output(char byte);
+static void publish_output();
+static void wait_for_output_writer(long long int tail);
+#endif
+
+static const long long int GLOBAL_QUEUE_INITIAL_CAPACITY = 16;
+static const long long int TAPE_INITIAL_CAPACITY = 4;
+
+short int bx_error = OK;
+long long int bx_max_call_depth = MAX_CALL_DEPTH_DEFAULT;
+struct TTape bx_tape;
+struct TFrame *bx_call_stack = NULL;
+long long int bx_call_depth = 0;
+uint64_t *bx_if_else_stack = NULL;
+long long int bx_if_else_depth = 0;
+long long int bx_if_else_base = 0;
+long long int bx_if_else_max_depth = 0;
+struct TBits *bx_global_queue = NULL;
+long long int bx_global_queue_capacity = 0;
+long long int bx_global_queue_front = 0;
+long long int bx_global_queue_length = 0;
+int bx_input_fd = STDIN_FILENO;
+int bx_output_fd = STDOUT_FILENO;
+bool bx_unbuffered_output = false;
+bool bx_input_through_stdio = false;
+bool bx_async_output = false;
+#ifdef USE_STATS
+bool bx_count_memory = false;
+struct TMemoryStats bx_memory_stats;
+#endif
+
+static long long int call_stack_capacity = 0;
+static long long int if_else_stack_capacity = 0;
+
+/* What the program prints, kept here and written to "bx_output_fd" in one
+ * block when the buffer is full, before reading input, and at the end. */
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static long long int output_length = 0;
+
+/* What the program reads: "input_length" bytes at "input_data", either read
+ * ahead from "bx_input_fd" into "input_buffer", or the whole input file
+ * mapped in memory. */
+static char input_buffer[INPUT_BUFFER_SIZE];
+static const char *input_data = input_buffer;
+static long long int input_length = 0;
+static long long int input_pos = 0;
+static bool input_mapped = false;
+static bool end_of_input = false;
+
+#ifdef USE_ASYNC_OUTPUT
+/* With "bx_async_output" the output goes through "output_ring" instead of
+ * "output_buffer": the program writes at "ring_end" and makes what it has
+ * written available to the writer thread by moving "ring_head" there; the
+ * writer moves "ring_tail" past what it has written. The positions only grow,
+ * and are taken modulo the size of the ring. Either thread sleeps on
+ * "ring_cond" only after flagging it, so that the other one knows to wake it
+ * up. */
+static char output_ring[OUTPUT_RING_SIZE];
+static long long int ring_end = 0;
+static long long int ring_head = 0;
+static long long int ring_tail = 0;
+static long long int ring_tail_seen = 0;
+static bool ring_closed = false;
+static bool writer_waiting = false;
+static bool interpreter_waiting = false;
+static pthread_t output_writer;
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* The cell "index" of "tape", visiting the ones up to it; it may move the
+ * cells. */
+struct TCell *
+bx_reach_cell(struct TTape *tape, long long int index)
+{
+	long long int old_capacity = tape->capacity;
+
+	if (index >= tape->n_cells) {
+		if (index >= tape->capacity) {
+			while (index >= tape->capacity) {
+				tape->capacity *= 2;
+			}
+			bx_count_release(old_capacity * sizeof(struct TCell));
+			tape->cells = realloc(
+			    tape->cells, tape->capacity * sizeof(struct TCell));
+			bx_count_allocation(
+			    tape->capacity * sizeof(struct TCell));
+			memset(
+			    tape->cells + old_capacity, 0,
+			    (tape->capacity - old_capacity) *
+				sizeof(struct TCell));
+		}
+		tape->n_cells = index + 1;
+	}
+	return tape->cells + index;
+}
+
+/* Push the running function, whose selected cell is "cell", on the call
+ * stack; it goes on from "return_pos" once the callee has returned. */
+void
+bx_save_caller(long long int return_pos, struct TCell *cell)
+{
+	struct TFrame *caller;
+
+	if (bx_call_depth == call_stack_capacity) {
+		call_stack_capacity =
+		    call_stack_capacity == 0 ? 64 : call_stack_capacity * 2;
+		bx_count_release(bx_call_depth * sizeof(struct TFrame));
+		bx_call_stack = realloc(
+		    bx_call_stack, call_stack_capacity * sizeof(struct TFrame));
+		bx_count_allocation(
+		    call_stack_capacity * sizeof(struct TFrame));
+	}
+	caller = &bx_call_stack[bx_call_depth++];
+	caller->return_pos = return_pos;
+	caller->tape = bx_tape;
+	caller->index_of_the_selected_cell = cell - bx_tape.cells;
+	caller->if_else_base = bx_if_else_base;
+	caller->if_else_depth = bx_if_else_depth;
+}
+
+/* Start a function with only its first cell visited, which is selected. */
+void
+bx_enter_function()
+{
+	bx_tape.capacity = TAPE_INITIAL_CAPACITY;
+	bx_tape.cells = calloc(bx_tape.capacity, sizeof(struct TCell));
+	bx_count_allocation(bx_tape.capacity * sizeof(struct TCell));
+	bx_tape.n_cells = 1;
+
+	/* Start with no open if-else statements. */
+	bx_if_else_base = bx_if_else_depth;
+	if (bx_if_else_base + bx_if_else_max_depth > if_else_stack_capacity) {
+		if_else_stack_capacity =
+		    (bx_if_else_base + bx_if_else_max_depth) * 2 + 64;
+		bx_if_else_stack = realloc(
+		    bx_if_else_stack,
+		    (if_else_stack_capacity / 64 + 1) * sizeof(uint64_t));
+	}
+}
+
+/* Free the cells of the running function and restore its caller; returns the
+ * frame of the caller, just popped, or NULL if it was the main function. */
+struct TFrame *
+bx_leave_function()
+{
+	struct TFrame *caller;
+
+	for (long long int i = 0; i < bx_tape.n_cells; i++) {
+		bx_release_bits(&bx_tape.cells[i].bits);
+	}
+	bx_count_release(bx_tape.capacity * sizeof(struct TCell));
+	free(bx_tape.cells);
+	bx_tape.cells = NULL;
+	if (bx_call_depth == 0) {
+		/* The main function has terminated. */
+		return NULL;
+	}
+
+	caller = &bx_call_stack[--bx_call_depth];
+	bx_tape = caller->tape;
+	bx_if_else_base = caller->if_else_base;
+	bx_if_else_depth = caller->if_else_depth;
+	return caller;
+}
+
+void
+bx_free_call_stack()
+{
+	free(bx_call_stack);
+	bx_call_stack = NULL;
+	call_stack_capacity = 0;
+	free(bx_if_else_stack);
+	bx_if_else_stack = NULL;
+	if_else_stack_capacity = 0;
+}
+
+/* Make the first "length" bits writable: the words are grown if they're too
+ * few, and copied if they're shared. */
+void
+bx_reserve_bits(struct TBits *bits, long long int length)
+{
+	struct TWords *buffer = bits->buffer;
+	long long int needed_words = (length + 63) / 64;
+	long long int used_words = (bits->length + 63) / 64;
+	long long int n_words = buffer == NULL ? 0 : buffer->n_words;
+	long long int new_n_words;
+
+	if (buffer != NULL && buffer->n_references > 1) {
+		new_n_words = needed_words > used_words ? needed_words
+							: used_words;
+		bits->buffer = calloc(
+		    1, sizeof(struct TWords) + new_n_words * sizeof(uint64_t));
+		bx_count_allocation(
+		    sizeof(struct TWords) + new_n_words * sizeof(uint64_t));
+		bits->buffer->n_references = 1;
+		bits->buffer->n_words = new_n_words;
+		memcpy(
+		    bits->buffer->words, buffer->words,
+		    used_words * sizeof(uint64_t));
+		buffer->n_references--;
+		return;
+	}
+
+	if (needed_words <= n_words) {
+		return;
+	}
+	new_n_words = n_words * 2;
+	if (new_n_words < needed_words) {
+		new_n_words = needed_words;
+	}
+	if (buffer != NULL) {
+		bx_count_release(
+		    sizeof(struct TWords) + n_words * sizeof(uint64_t));
+	}
+	buffer = realloc(
+	    buffer, sizeof(struct TWords) + new_n_words * sizeof(uint64_t));
+	bx_count_allocation(
+	    sizeof(struct TWords) + new_n_words * sizeof(uint64_t));
+	memset(
+	    buffer->words + n_words, 0,
+	    (new_n_words - n_words) * sizeof(uint64_t));
+	buffer->n_references = 1;
+	buffer->n_words = new_n_words;
+	bits->buffer = buffer;
+}
+
+/* The null bits up to "length" become 0; no word changes, so if there's room
+ * the words don't have to be copied even when they're shared. */
+void
+bx_extend_bits(struct TBits *bits, long long int length)
+{
+	if (bits->buffer == NULL || length > bits->buffer->n_words * 64) {
+		bx_reserve_bits(bits, length);
+	}
+	bx_count_bits_in_cells(length - bits->length);
+	bits->length = length;
+}
+
+void
+bx_truncate_bits(struct TBits *bits, long long int length)
+{
+	long long int first_word = length / 64;
+	long long int end_word = (bits->length + 63) / 64;
+
+	if (length >= bits->length) {
+		return;
+	}
+
+	if (bits->buffer->n_references > 1) {
+		if (length == 0) {
+			/* Nothing to copy. */
+			bx_release_bits(bits);
+			return;
+		}
+		bx_reserve_bits(bits, length);
+	}
+
+	/* Keep the null bits to 0. */
+	if (length % 64 != 0) {
+		bits->buffer->words[first_word] &=
+		    ((uint64_t)1 << (length % 64)) - 1;
+		first_word++;
+	}
+	if (end_word > first_word) {
+		memset(
+		    bits->buffer->words + first_word, 0,
+		    (end_word - first_word) * sizeof(uint64_t));
+	}
+	bx_count_bits_in_cells(length - bits->length);
+	bits->length = length;
+}
+
+/* Drop a reference to the words, freeing them if it was the last one. */
+void
+bx_release_bits(struct TBits *bits)
+{
+	if (bits->buffer != NULL && --bits->buffer->n_references == 0) {
+		bx_count_release(
+		    sizeof(struct TWords) +
+		    bits->buffer->n_words * sizeof(uint64_t));
+		free(bits->buffer);
+	}
+	bx_count_bits_in_cells(-bits->length);
+	bits->buffer = NULL;
+	bits->length = 0;
+}
+
+/* Set the selected bit; a null one becomes "value", and the bits after it
+ * stay null. */
+void
+bx_set_bit(struct TCell *cell, bool value)
+{
+	struct TBits *bits = &cell->bits;
+	long long int i = cell->selected_bit;
+
+	if (i == bits->length) {
+		bx_reserve_bits(bits, bits->length + 1);
+		bits->length++;
+		bx_count_bits_in_cells(1);
+	} else if ((bits->buffer->words[i / 64] >> (i % 64) & 1) == value) {
+		return;
+	} else {
+		bx_reserve_bits(bits, bits->length);
+	}
+	if (value) {
+		bits->buffer->words[i / 64] |= (uint64_t)1 << (i % 64);
+	} else {
+		bits->buffer->words[i / 64] &= ~((uint64_t)1 << (i % 64));
+	}
+}
+
+/* Go to the next bit, as '+' does, and then on to the first bit that "target"
+ * says, or to the first null one. */
+void
+bx_seek_bit(struct TCell *cell, int target)
+{
+	long long int i;
+	uint64_t word;
+
+	if (cell->selected_bit == cell->bits.length) {
+		/* The null bit becomes 0. */
+		bx_extend_bits(&cell->bits, cell->bits.length + 1);
+	}
+	cell->selected_bit++;
+	if (target == SEEK_NULL) {
+		cell->selected_bit = cell->bits.length;
+		return;
+	}
+
+	/* The null bits are 0 in the words, and 1 once they're flipped to look
+	 * for a 0: either way, the bit found is never after the first null
+	 * one. */
+	for (i = cell->selected_bit; i < cell->bits.length; i += 64 - i % 64) {
+		word = cell->bits.buffer->words[i / 64];
+		if (target == SEEK_ZERO) {
+			word = ~word;
+		}
+		word >>= i % 64;
+		if (word != 0) {
+			i += bx_first_one(word);
+			break;
+		}
+	}
+	cell->selected_bit = i < cell->bits.length ? i : cell->bits.length;
+}
+
+/* Give the cell the "length" bits of "value", at most 64, selecting the bit
+ * "selected_bit". */
+void
+bx_store_literal(
+    struct TCell *cell, uint64_t value, long long int length,
+    long long int selected_bit)
+{
+	bx_truncate_bits(&cell->bits, 0);
+	if (length > 0) {
+		bx_reserve_bits(&cell->bits, length);
+		cell->bits.buffer->words[0] = value;
+		cell->bits.length = length;
+		bx_count_bits_in_cells(length);
+	}
+	cell->selected_bit = selected_bit;
+}
+
+void
+bx_enqueue(struct TCell *cell)
+{
+	struct TBits *entry;
+	long long int old_capacity = bx_global_queue_capacity;
+
+	if (bx_global_queue_length == bx_global_queue_capacity) {
+		bx_global_queue_capacity = old_capacity == 0
+					       ? GLOBAL_QUEUE_INITIAL_CAPACITY
+					       : old_capacity * 2;
+		bx_count_release(old_capacity * sizeof(struct TBits));
+		bx_global_queue = realloc(
+		    bx_global_queue,
+		    bx_global_queue_capacity * sizeof(struct TBits));
+		bx_count_allocation(
+		    bx_global_queue_capacity * sizeof(struct TBits));
+		/* Unwrap the entries that were after the end of the ring. */
+		if (bx_global_queue_front + bx_global_queue_length >
+		    old_capacity) {
+			memcpy(
+			    bx_global_queue + old_capacity, bx_global_queue,
+			    (bx_global_queue_front + bx_global_queue_length -
+			     old_capacity) *
+				sizeof(struct TBits));
+		}
+	}
+
+	/* Share the words instead of copying them. */
+	entry = bx_global_queue +
+		((bx_global_queue_front + bx_global_queue_length) &
+		 (bx_global_queue_capacity - 1));
+	*entry = cell->bits;
+	if (entry->buffer != NULL) {
+		entry->buffer->n_references++;
+	}
+	bx_global_queue_length++;
+	count_bits_in_queue(entry->length);
+}
+
+/* Move the front value of the queue to the cell, selecting its first bit;
+ * false if the queue is empty. */
+bool
+bx_dequeue(struct TCell *cell)
+{
+	if (bx_global_queue_length == 0) {
+		bx_error = ERR_EMPTY_GLOBAL_STACK;
+		return false;
+	}
+
+	/* Move the bits instead of copying them. */
+	bx_release_bits(&cell->bits);
+	cell->selected_bit = 0;
+	cell->bits = bx_global_queue[bx_global_queue_front];
+	bx_count_bits_in_cells(cell->bits.length);
+
+	bx_global_queue_front =
+	    (bx_global_queue_front + 1) & (bx_global_queue_capacity - 1);
+	bx_global_queue_length--;
+	count_bits_in_queue(-cell->bits.length);
+	return true;
+}
+
+void
+bx_free_global_queue()
+{
+	for (long long int i = 0; i < bx_global_queue_length; i++) {
+		bx_release_bits(
+		    bx_global_queue + ((bx_global_queue_front + i) &
+				       (bx_global_queue_capacity - 1)));
+	}
+	free(bx_global_queue);
+	bx_global_queue = NULL;
+	bx_global_queue_length = 0;
+}
+
+/* After a value has entered or left the global queue. */
+void
+count_bits_in_queue(long long int change)
+{
+#ifdef USE_STATS
+	struct TMemoryStats *stats = &bx_memory_stats;
+
+	if (bx_count_memory) {
+		stats->bits_in_queue += change;
+		if (stats->bits_in_queue > stats->max_bits_in_queue) {
+			stats->max_bits_in_queue = stats->bits_in_queue;
+		}
+		if (bx_global_queue_length > stats->max_queue_length) {
+			stats->max_queue_length = bx_global_queue_length;
+		}
+	}
+#else
+	(void)change;
+#endif
+}
+
+void
+bx_output(struct TCell *cell)
+{
+	/* Only the 8 least significant bits fit in the character. */
+	char character = 0;
+	if (cell->bits.length > 0) {
+		character = (char)(cell->bits.buffer->words[0] & 0xFF);
+	}
+
+	bx_output_character(character);
+}
+
+void
+bx_output_character(char character)
+{
+	bx_buffer_output(&character, 1);
+}
+
+void
+bx_buffer_output(const char *bytes, long long int length)
+{
+	for (long long int i = 0; i < length; i++) {
+#ifdef USE_ASYNC_OUTPUT
+		if (bx_async_output) {
+			push_output(bytes[i]);
+			continue;
+		}
+#endif
+		if (output_length == OUTPUT_BUFFER_SIZE) {
+			bx_flush_output();
+		}
+		output_buffer[output_length++] = bytes[i];
+	}
+
+	if (bx_unbuffered_output) {
+		bx_flush_output();
+	}
+}
+
+void
+bx_flush_output()
+{
+	/* Anything already printed with "printf" comes first. */
+	fflush(stdout);
+
+#ifdef USE_ASYNC_OUTPUT
+	if (bx_async_output) {
+		wait_for_output_writer(ring_end);
+		return;
+	}
+#endif
+	write_output(output_buffer, output_length);
+	output_length = 0;
+}
+
+void
+write_output(const char *bytes, long long int length)
+{
+	long long int written = 0;
+	ssize_t n;
+
+	while (written < length) {
+		n = write(bx_output_fd, bytes + written, length - written);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			/* Nowhere to write it: it's lost, as with "printf". */
+			break;
+		}
+		written += n;
+	}
+}
+
+void
+bx_start_output_writer()
+{
+#ifdef USE_ASYNC_OUTPUT
+	if (bx_async_output == false) {
+		return;
+	}
+	if (pthread_create(&output_writer, NULL, run_output_writer, NULL) !=
+	    0) {
+		/* Write the output from this thread, then. */
+		bx_async_output = false;
+	}
+#else
+	bx_async_output = false;
+#endif
+}
+
+/* Once the output has been flushed. */
+void
+bx_stop_output_writer()
+{
+#ifdef USE_ASYNC_OUTPUT
+	if (bx_async_output) {
+		pthread_mutex_lock(&ring_mutex);
+		ring_closed = true;
+		pthread_cond_signal(&ring_cond);
+		pthread_mutex_unlock(&ring_mutex);
+		pthread_join(output_writer, NULL);
+	}
+#endif
+}
+
+#ifdef USE_ASYNC_OUTPUT
+void *
+run_output_writer(void *unused)
+{
+	long long int head;
+	long long int tail = 0;
+	long long int start;
+	long long int length;
+
+	(void)unused;
+	for (;;) {
+		head = wait_for_output(tail);
+		if (head == tail) {
+			/* The ring has been closed. */
+			return NULL;
+		}
+
+		/* As much as there is up to the end of the ring at once. */
+		start = tail % OUTPUT_RING_SIZE;
+		length = head - tail;
+		if (length > OUTPUT_RING_SIZE - start) {
+			length = OUTPUT_RING_SIZE - start;
+		}
+		write_output(output_ring + start, length);
+		tail += length;
+
+		__atomic_store_n(&ring_tail, tail, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&interpreter_waiting, __ATOMIC_SEQ_CST)) {
+			pthread_mutex_lock(&ring_mutex);
+			pthread_cond_signal(&ring_cond);
+			pthread_mutex_unlock(&ring_mutex);
+		}
+	}
+}
+
+/* Until the program makes some output after "tail" available, or closes the
+ * ring; returns "ring_head". */
+long long int
+wait_for_output(long long int tail)
+{
+	long long int head = __atomic_load_n(&ring_head, __ATOMIC_SEQ_CST);
+
+	if (head != tail) {
+		return head;
+	}
+
+	pthread_mutex_lock(&ring_mutex);
+	__atomic_store_n(&writer_waiting, true, __ATOMIC_SEQ_CST);
+	while ((head = __atomic_load_n(&ring_head, __ATOMIC_SEQ_CST)) ==
+		   tail &&
+	       ring_closed == false) {
+		pthread_cond_wait(&ring_cond, &ring_mutex);
+	}
+	__atomic_store_n(&writer_waiting, false, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&ring_mutex);
+	return head;
+}
+
+void
+push_output(char byte)
+{
+	if (ring_end - ring_tail_seen == OUTPUT_RING_SIZE) {
+		wait_for_output_writer(ring_end - OUTPUT_RING_SIZE + 1);
+	}
+	output_ring[ring_end % OUTPUT_RING_SIZE] = byte;
+	ring_end++;
+
+	/* The writer gets the output in blocks as large as the ones written
+	 * without "bx_async_output". */
+	if (ring_end - ring_head >= OUTPUT_BUFFER_SIZE) {
+		publish_output();
+	}
+}
+
+void
+publish_output()
+{
+	__atomic_store_n(&ring_head, ring_end, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&writer_waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&ring_mutex);
+		pthread_cond_signal(&ring_cond);
+		pthread_mutex_unlock(&ring_mutex);
+	}
+}
+
+/* Until the writer has written everything before "tail". */
+void
+wait_for_output_writer(long long int tail)
+{
+	publish_output();
+	ring_tail_seen = __atomic_load_n(&ring_tail, __ATOMIC_SEQ_CST);
+	if (ring_tail_seen >= tail) {
+		return;
+	}
+
+	pthread_mutex_lock(&ring_mutex);
+	__atomic_store_n(&interpreter_waiting, true, __ATOMIC_SEQ_CST);
+	while ((ring_tail_seen = __atomic_load_n(
+		    &ring_tail, __ATOMIC_SEQ_CST)) < tail) {
+		pthread_cond_wait(&ring_cond, &ring_mutex);
+	}
+	__atomic_store_n(&interpreter_waiting, false, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&ring_mutex);
+}
+#endif
+
+/* Read a character into the cell; at the end of the input its bits are left
+ * all null, which no character does. False on a read error. */
+bool
+bx_input(struct TCell *cell)
+{
+	char n;
+	int value;
+	long long int length = 0;
+
+	/* Whatever the program asks, the user gets to see it first. */
+	bx_flush_output();
+
+	cell->selected_bit = 0;
+	bx_truncate_bits(&cell->bits, 0);
+	if (read_input(&n) == false) {
+		return bx_error == OK;
+	}
+
+	/* A negative character is saved as its absolute value; 0 still takes
+	 * one bit. */
+	value = n < 0 ? -n : n;
+	do {
+		length++;
+	} while ((value >> length) != 0);
+	bx_reserve_bits(&cell->bits, length);
+	cell->bits.buffer->words[0] = (uint64_t)value;
+	bx_count_bits_in_cells(length - cell->bits.length);
+	cell->bits.length = length;
+	cell->selected_bit = 0;
+	return true;
+}
+
+/* Reads the next byte of the input of the program; false at its end, or on
+ * a read error. */
+bool
+read_input(char *byte)
+{
+	int c;
+	ssize_t n;
+
+	if (bx_input_through_stdio) {
+		c = getchar();
+		if (c == EOF) {
+			return false;
+		}
+		*byte = (char)c;
+		return true;
+	}
+
+	if (input_pos == input_length) {
+		if (input_mapped || end_of_input) {
+			return false;
+		}
+		do {
+			n = read(bx_input_fd, input_buffer, INPUT_BUFFER_SIZE);
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0) {
+			if (n < 0) {
+				bx_error = ERR_USER_INPUT;
+			}
+			end_of_input = true;
+			return false;
+		}
+		input_length = n;
+		input_pos = 0;
+	}
+
+	*byte = input_data[input_pos++];
+	return true;
+}
+
+/* Read the input straight from memory, if "bx_input_fd" is a regular file
+ * that can be mapped there. */
+void
+bx_map_input()
+{
+	struct stat input_stat;
+	void *mapping;
+
+	if (fstat(bx_input_fd, &input_stat) == 0 &&
+	    S_ISREG(input_stat.st_mode) && input_stat.st_size > 0) {
+		mapping = mmap(
+		    NULL, input_stat.st_size, PROT_READ, MAP_PRIVATE,
+		    bx_input_fd, 0);
+		if (mapping != MAP_FAILED) {
+			input_data = mapping;
+			input_length = input_stat.st_size;
+			input_mapped = true;
+		}
+	}
+}
+
+void
+bx_unmap_input()
+{
+	if (input_mapped) {
+		munmap((void *)input_data, input_length);
+	}
+}
+
+void
+bx_process_errors()
+{
+	if (bx_error) {
+		bx_flush_output();
+		fprintf(
+		    stderr,
+		    "\nThe program has been terminated due to an error:\n  ");
+		switch (bx_error) {
+		case ERR_MISPLACED_ELSE:
+			fprintf(stderr, "misplaced else statement");
+			break;
+		case ERR_END_IF:
+			fprintf(
+			    stderr,
+			    "unexpected end of IF condition or else statement");
+			break;
+		case ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS:
+			fprintf(
+			    stderr, "label pointer moved outside of bounds");
+			break;
+		case ERR_JUMP_BUT_NO_LABEL:
+			fprintf(
+			    stderr, "call or jump to a label, but there is "
+				    "no label at all");
+			break;
+		case ERR_READ_SOURCE_PROGRAM:
+			fprintf(stderr, "can't read the source program file");
+			break;
+		case ERR_EMPTY_GLOBAL_STACK:
+			fprintf(
+			    stderr, "tried to pop from the global stack "
+				    "but it's empty");
+			break;
+		case ERR_USER_INPUT:
+			fprintf(stderr, "bad input");
+			break;
+		case ERR_CALL_STACK_OVERFLOW:
+			fprintf(
+			    stderr, "too many nested function calls (more "
+				    "than %lld)",
+			    bx_max_call_depth);
+			break;
+		default:
+			fprintf(stderr, "unknown error");
+		}
+		bx_buffer_output(".\n", 2);
+
+		/* Prevent multiple prints. */
+		bx_error = OK;
+	}
+}
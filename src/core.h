@@ -0,0 +1,269 @@
+/*
+ * core.h
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+/* What the interpreter and the C translations of BoolX programs, run on
+ * "runtime.c", have in common: the values of the cells, the cells of the
+ * running functions and their callers, the if-else statements, the global
+ * queue, the input and the output of the program, and its errors; they're
+ * compiled together with "core.c". */
+
+#ifndef BOOLX_CORE_H
+#define BOOLX_CORE_H
+
+#include <stdbool.h> // bool
+#include <stdint.h>  // uint64_t
+
+/* The "-s" option of the interpreter counts what the program does, and
+ * reports it at the end; compile with -DNO_STATS to leave the counters out,
+ * in which case "-s" is ignored. */
+#ifndef NO_STATS
+#define USE_STATS
+#endif
+
+#define MAX_CALL_DEPTH_DEFAULT 1000000
+#define PRINT_NEW_LINE_AFTER_TERMINATION true
+
+enum errors {
+	OK = 0,
+	ERR_MISPLACED_ELSE,
+	ERR_END_IF,
+	ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS,
+	ERR_JUMP_BUT_NO_LABEL,
+	ERR_READ_SOURCE_PROGRAM,
+	ERR_EMPTY_GLOBAL_STACK,
+	ERR_USER_INPUT,
+	ERR_CALL_STACK_OVERFLOW,
+	N_ERRORS
+};
+/* Where a bit scan stops: at the first null bit, or at the first 1 or 0
+ * before it. */
+enum seek_targets { SEEK_NULL, SEEK_ONE, SEEK_ZERO };
+enum condition_types { CONDITION_IF, CONDITION_ELSE };
+
+/* The words of one or more values: a cell and the queue entries enqueued from
+ * it share them, until one of them has to be changed. */
+struct TWords {
+	long long int n_references;
+	long long int n_words;
+	uint64_t words[];
+};
+
+/* The bits of a value, packed 64 per word from the least significant one.
+ * Every bit from "length" on is null; in the words those bits are always
+ * kept to 0, so that appending a 0 bit only takes to increase "length".
+ * The words may be shared, so "bx_reserve_bits" has to be called before
+ * changing them. */
+struct TBits {
+	struct TWords *buffer;
+	long long int length;
+};
+
+/* Memory cell. */
+struct TCell {
+	struct TBits bits;
+
+	/* From 0 to "bits.length", the latter meaning that the selected bit is
+	 * null. */
+	long long int selected_bit;
+};
+
+/* The memory cells of a function, stored contiguously; the first "n_cells"
+ * are the ones visited so far, and all the others are already zeroed, that is
+ * null. */
+struct TTape {
+	struct TCell *cells;
+	long long int n_cells;
+	long long int capacity;
+};
+
+/* What a function call saves of the caller, to be restored on return. */
+struct TFrame {
+	long long int return_pos;
+	struct TTape tape;
+	long long int index_of_the_selected_cell;
+	long long int if_else_base;
+	long long int if_else_depth;
+};
+
+#ifdef USE_STATS
+/* What "-s" reports of the memory: the most that the program has had at once,
+ * and the bytes of the bits of the cells and of the queue, plus the ones that
+ * the interpreter counts of its own. */
+struct TMemoryStats {
+	long long int bits_in_cells;
+	long long int max_bits_in_cells;
+	long long int bits_in_queue;
+	long long int max_bits_in_queue;
+	long long int max_queue_length;
+	long long int allocated_bytes;
+	long long int freed_bytes;
+	long long int max_held_bytes;
+};
+#endif
+
+extern short int bx_error;
+extern long long int bx_max_call_depth;
+/* The cells of the running function, and the callers of it, the last one on
+ * top. */
+extern struct TTape bx_tape;
+extern struct TFrame *bx_call_stack;
+extern long long int bx_call_depth;
+/* The open if-else statements of all the running functions, one bit each
+ * holding its "enum condition_types"; "bx_if_else_base" is where the ones of
+ * the current function start. A function can't open more statements than
+ * "bx_if_else_max_depth", the deepest nesting in the program, so the stack
+ * only has to be grown when a function is called. */
+extern uint64_t *bx_if_else_stack;
+extern long long int bx_if_else_depth;
+extern long long int bx_if_else_base;
+extern long long int bx_if_else_max_depth;
+/* The global queue, a ring of "bx_global_queue_capacity" values (always a
+ * power of two) starting from the front one; an entry shares the words of the
+ * cell it was enqueued from. */
+extern struct TBits *bx_global_queue;
+extern long long int bx_global_queue_capacity;
+extern long long int bx_global_queue_front;
+extern long long int bx_global_queue_length;
+/* Where the input is read from and the output written to, the standard ones
+ * unless they're changed before running; the debug mode of the interpreter
+ * writes every output at once, and reads the standard input through
+ * "getchar", as it waits for "Enter" there. */
+extern int bx_input_fd;
+extern int bx_output_fd;
+extern bool bx_unbuffered_output;
+extern bool bx_input_through_stdio;
+/* Whether the output is written by a thread of its own. */
+extern bool bx_async_output;
+#ifdef USE_STATS
+extern bool bx_count_memory;
+extern struct TMemoryStats bx_memory_stats;
+#endif
+
+struct TCell *bx_reach_cell(struct TTape *tape, long long int index);
+void bx_save_caller(long long int return_pos, struct TCell *cell);
+void bx_enter_function();
+struct TFrame *bx_leave_function();
+void bx_free_call_stack();
+void bx_reserve_bits(struct TBits *bits, long long int length);
+void bx_extend_bits(struct TBits *bits, long long int length);
+void bx_truncate_bits(struct TBits *bits, long long int length);
+void bx_release_bits(struct TBits *bits);
+void bx_set_bit(struct TCell *cell, bool value);
+void bx_seek_bit(struct TCell *cell, int target);
+void bx_store_literal(
+    struct TCell *cell, uint64_t value, long long int length,
+    long long int selected_bit);
+void bx_enqueue(struct TCell *cell);
+bool bx_dequeue(struct TCell *cell);
+void bx_free_global_queue();
+void bx_output(struct TCell *cell);
+void bx_output_character(char character);
+void bx_buffer_output(const char *bytes, long long int length);
+void bx_flush_output();
+void bx_start_output_writer();
+void bx_stop_output_writer();
+bool bx_input(struct TCell *cell);
+void bx_map_input();
+void bx_unmap_input();
+void bx_process_errors();
+
+/* The index of the least significant 1 of a word that isn't 0. */
+static inline int
+bx_first_one(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int index = 0;
+
+	while ((word & 1) == 0) {
+		word >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+static inline void
+bx_push_if_else_statement()
+{
+	long long int depth = bx_if_else_depth++;
+
+	bx_if_else_stack[depth / 64] &= ~((uint64_t)1 << (depth % 64));
+}
+
+/* Whether the innermost if-else statement of the function is in its if
+ * block, as an else statement needs. */
+static inline bool
+bx_is_in_if_block()
+{
+	long long int top = bx_if_else_depth - 1;
+
+	return bx_if_else_depth > bx_if_else_base &&
+	       (bx_if_else_stack[top / 64] >> (top % 64) & 1) == CONDITION_IF;
+}
+
+static inline void
+bx_enter_else_block()
+{
+	long long int top = bx_if_else_depth - 1;
+
+	bx_if_else_stack[top / 64] |= (uint64_t)CONDITION_ELSE << (top % 64);
+}
+
+/* The counters of "-s", which cost nothing unless it's given, and nothing at
+ * all without USE_STATS. */
+static inline void
+bx_count_allocation(long long int n_bytes)
+{
+#ifdef USE_STATS
+	struct TMemoryStats *stats = &bx_memory_stats;
+
+	if (bx_count_memory) {
+		stats->allocated_bytes += n_bytes;
+		if (stats->allocated_bytes - stats->freed_bytes >
+		    stats->max_held_bytes) {
+			stats->max_held_bytes =
+			    stats->allocated_bytes - stats->freed_bytes;
+		}
+	}
+#else
+	(void)n_bytes;
+#endif
+}
+
+static inline void
+bx_count_release(long long int n_bytes)
+{
+#ifdef USE_STATS
+	if (bx_count_memory) {
+		bx_memory_stats.freed_bytes += n_bytes;
+	}
+#else
+	(void)n_bytes;
+#endif
+}
+
+static inline void
+bx_count_bits_in_cells(long long int change)
+{
+#ifdef USE_STATS
+	struct TMemoryStats *stats = &bx_memory_stats;
+
+	if (bx_count_memory) {
+		stats->bits_in_cells += change;
+		if (stats->bits_in_cells > stats->max_bits_in_cells) {
+			stats->max_bits_in_cells = stats->bits_in_cells;
+		}
+	}
+#else
+	(void)change;
+#endif
+}
+
+#endif
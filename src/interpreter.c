@@ -6,35 +6,122 @@
  * Distributed under the MIT License, see "license.txt"
  */
 
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, madvise
+
+#include "core.h"
+#include "tokenizer.h"
+
 #include <ctype.h> //isprint
+#include <errno.h> // errno
+#include <fcntl.h> // open
 #include <getopt.h>
-#include <math.h>    // pow
 #include <stdbool.h> // bool
+#include <stddef.h>  // offsetof
+#include <stdint.h>  // uint64_t
 #include <stdio.h>   // printf, getchar, file stuff
 #include <stdlib.h>  // malloc
 #include <stdlib.h>  // abort
-#include <string.h>  // string stuff
-
-#define BOOL1_T bool // See comment for "ignored_starting_bit".
+#include <string.h>  // memcpy, memset
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read, write, close
+
+/* The threaded engine jumps straight from an instruction to the code of the
+ * next one using GCC's labels as values; compile with -DNO_COMPUTED_GOTO, or
+ * with a compiler that doesn't have them, to dispatch with a switch instead. */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+/* On x86-64 the "-j" option compiles the decoded program to machine code;
+ * compile with -DNO_JIT to leave the compiler out. */
+#if defined(__x86_64__) && defined(__unix__) && !defined(NO_JIT)
+#define USE_JIT
+#endif
 
 struct TDebugState;
 
-struct TBit;
-struct TCell;
-struct TGlobalCell;
-struct TLabel;
-struct TIfElseStatement;
-
-static bool my_strcpy(char *destination, char *source, size_t max_length);
+struct TInstruction;
+struct TLiteral;
+struct TProfileNode;
+#ifdef USE_STATS
+struct TStats;
+#endif
+#ifdef USE_JIT
+struct TJitJump;
+#endif
 
 static int process_arguments(int argc, char *argv[]);
-
-static void register_all_labels(FILE *source_program);
+static bool open_input_and_output();
+static void close_input_and_output();
+
+static void load_source_program(int source_program);
+static void strip_source_program(
+    const char *source, long long int length,
+    long long int *n_nested_comments);
+static void append_instruction(char instruction);
+static void append_label(long long int program_pos);
+static void build_if_else_jump_table();
+static void decode_program();
+static long long int fuse_moves(long long int pos);
+static void resolve_labels();
+static void address_cells_by_offset();
+static long long int
+balanced_statement_end(long long int pos, long long int offset);
+static void fold_literals();
+static bool fold_instruction(
+    struct TLiteral *literal, const struct TInstruction *instruction);
+static long long int write_literals(
+    struct TLiteral *literals, int n_literals, long long int write_pos);
+static void find_bit_scans();
+static void find_intrinsics();
+static void execute_source_program();
+static void execute_decoded_program();
+static void execute_compiled_program();
+static void emit_c_program();
+static bool
+emit_c_skip_if_else_block(long long int target, const char *indentation);
+#ifdef USE_JIT
+static bool compile_program();
+static void compile_instruction(long long int pos);
+static void jit_emit_move_cursor(long long int distance);
+static int jit_emit_select_target_cell(struct TInstruction *instruction);
+static void jit_emit_skip_if_else_block(long long int target);
+static void jit_emit_label_check();
+static void jit_emit_error_check();
+static void jit_emit_reload();
+static void jit_emit_bit_operation(int operation, long long int displacement);
+static long long int jit_global(const void *variable);
+static int32_t jit_immediate(long long int value);
+static void jit_emit_byte(int byte);
+static void jit_emit_u32(uint32_t value);
+static void jit_emit_u64(uint64_t value);
 static void
-execute_source_program_function(FILE *source_program, long long int from_pos);
-static void process_current_instruction(FILE *source_program);
-
-static void instruction_if_condition_common();
+jit_emit_opcode(bool wide, int opcode, int reg, int index, int base);
+static void jit_emit_register_operand(bool wide, int opcode, int reg, int rm);
+static void jit_emit_memory_operand(
+    bool wide, int opcode, int reg, int base, int index,
+    long long int displacement);
+static void jit_emit_load(int reg, int base, long long int displacement);
+static void jit_emit_store(int base, long long int displacement, int reg);
+static void jit_emit_move_immediate(int reg, uint64_t value);
+static void jit_emit_call(uintptr_t function);
+static long long int jit_emit_jump(int condition);
+static void jit_patch_jump(long long int at, long long int target);
+static void jit_emit_jump_to_pos(int condition, long long int pos);
+static const unsigned char *
+jit_call(long long int return_pos, long long int target);
+static const unsigned char *jit_return();
+static const unsigned char *jit_fail(int code);
+static void jit_move_cursor(long long int distance);
+static struct TCell *jit_target_cell(long long int offset);
+#endif
+static void save_caller();
+static void enter_function(long long int from_pos);
+static bool leave_function();
+static void process_current_instruction();
+
+static void skip_if_else_block();
 static void instruction_if_condition_equal_to_1();
 static void instruction_if_condition_equal_to_null();
 static void instruction_else_condition();
@@ -56,7 +143,7 @@ static void instruction_global_queue_dequeue();
 static void instruction_select_next_label();
 static void instruction_select_previous_label();
 static void instruction_select_first_label();
-static void instruction_jump_to_label(FILE *source_program);
+static void instruction_jump_to_label();
 static void instruction_call_function();
 static void instruction_return();
 
@@ -65,127 +152,308 @@ static void dbg_print_instruction();
 static void dbg_print_stack_info();
 static void dbg_print_n_cells(int n);
 static void dbg_print_n_global_cells(int n);
-static void dbg_print_cell_value_common(
-    struct TBit *ignored_starting_bit, struct TBit *selected_bit);
+static void
+dbg_print_cell_value_common(struct TBits *bits, long long int selected_bit);
 static void dbg_print_cell_value(struct TCell *cell);
-static void dbg_print_global_cell_value(struct TGlobalCell *gl_cell);
+static void dbg_print_global_cell_value(struct TBits *bits);
+
+static void start_profile();
+static void record_source_offset(long long int offset);
+static void keep_profile_source(const char *source, long long int length);
+static void profile_instruction(long long int pos);
+static void profile_call(long long int label);
+static void profile_return();
+static void write_profile();
+static void write_profile_listing(
+    FILE *file, long long int *skipped, long long int *label_lines);
+static void write_folded_stacks(FILE *file, long long int *label_lines);
+static void write_profile_frame(
+    FILE *file, long long int node, long long int *label_lines);
+
+static void count_instruction(char instruction);
+static void count_call();
+static void count_jump();
+static void count_cells(long long int n_cells);
+static void print_stats();
 
 static void clear_if_else_statements();
-static void free_local_function_memory();
 static void free_global_variables();
 static void free_cell_content(struct TCell *cell);
-static void free_global_cell_content(struct TGlobalCell *g_cell);
+
+static bool get_bit(struct TBits *bits, long long int index);
+
+static struct TCell *
+next_cell(struct TTape *cells, struct TCell *cell, long long int distance);
+static void go_to_next_bit(struct TCell *cell);
+static void set_bit_to_zero(struct TCell *cell);
+static void set_bit_to_one(struct TCell *cell);
+static long long int call_intrinsic(long long int function);
+static void intrinsic_add(bool subtract);
+static long long int intrinsic_normalize();
+static void intrinsic_show_binary();
+static uint64_t get_word(struct TBits *bits, long long int index);
 
 static void output(struct TCell *cell);
+static void output_character(char character);
 static void input(struct TCell *cell);
 
-static void process_errors();
-
-enum condition_types { CONDITION_IF, CONDITION_ELSE };
-enum errors {
-	OK = 0,
-	ERR_STRING_TOO_LONG,
-	ERR_MISPLACED_ELSE,
-	ERR_END_IF,
-	ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS,
-	ERR_JUMP_BUT_NO_LABEL,
-	ERR_SEEK_PROGRAM_POSITION,
-	ERR_EMPTY_GLOBAL_STACK,
-	ERR_USER_INPUT,
+/* The instructions of the decoded program, in the order of the summary in the
+ * readme; the end of the program is a return. */
+enum opcodes {
+	OP_NEXT_CELL,
+	OP_PREVIOUS_CELL,
+	OP_FIRST_CELL,
+	OP_NEXT_BIT,
+	OP_PREVIOUS_BIT,
+	OP_FIRST_BIT,
+	OP_SET_BIT_TO_ZERO,
+	OP_SET_BIT_TO_ONE,
+	OP_SET_BIT_TO_NULL,
+	OP_SET_ALL_BITS_TO_NULL,
+	OP_OUTPUT,
+	OP_INPUT,
+	OP_ENQUEUE,
+	OP_DEQUEUE,
+	OP_IF_EQUAL_TO_1,
+	OP_IF_EQUAL_TO_NULL,
+	OP_ELSE,
+	OP_END_IF,
+	OP_LABEL,
+	OP_NEXT_LABEL,
+	OP_PREVIOUS_LABEL,
+	OP_FIRST_LABEL,
+	OP_JUMP,
+	OP_CALL,
+	OP_RETURN,
+	/* Moves that cancel each other out. */
+	OP_NOP,
+	/* Label moves, jumps and calls with a label known before running. */
+	OP_SELECT_LABEL,
+	OP_DIRECT_JUMP,
+	OP_DIRECT_CALL,
+	/* Runs of bit instructions with a known result. */
+	OP_STORE_LITERAL,
+	OP_OUTPUT_CHARACTER,
+	/* A direct call to a function of the library that can run natively. */
+	OP_INTRINSIC_CALL,
+	/* The '+' of a loop that only moves forward until a test succeeds,
+	 * going on to where the test does. */
+	OP_SEEK_BIT,
+	N_OPCODES
+};
+/* The functions of "bin/libraries/basic functions.bx". */
+enum intrinsics {
+	INTRINSIC_NONE = 0,
+	INTRINSIC_ADD,
+	INTRINSIC_SUB,
+	INTRINSIC_NORMALIZE,
+	INTRINSIC_SHOW_BINARY,
+	N_INTRINSICS
+};
+#ifdef USE_JIT
+/* What the machine code is made of. */
+enum registers { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11,
+		 R12, R13, R14, R15 };
+enum conditions {
+	JUMP_ALWAYS = -1,
+	BELOW = 0x2,
+	EQUAL = 0x4,
+	NOT_EQUAL = 0x5,
+	LESS = 0xC,
+	GREATER_OR_EQUAL = 0xD,
+	LESS_OR_EQUAL = 0xE
+};
+enum bit_operations {
+	BIT_TEST = 0x0FA3,
+	BIT_TEST_AND_SET = 0x0FAB,
+	BIT_TEST_AND_RESET = 0x0FB3
 };
+#endif
+
+/* The longest value, and the most cells at once, that literal folding keeps
+ * track of. */
+#define MAX_LITERAL_LENGTH 64
+#define MAX_LITERALS 16
+#define SOURCE_BUFFER_SIZE 65536
+/* Calls nested deeper than this are profiled as part of the function at this
+ * depth. */
+#define PROFILE_MAX_DEPTH 1000
 
-static const bool PRINT_NEW_LINE_AFTER_TERMINATION = true;
-static const bool DBG_SKIP_COMMENTS = true;
-static const bool DBG_SKIP_NON_EXECUTED_INSTRUCTIONS = true;
-static const bool DBG_SKIP_EMPTY_CHARACTERS = true;
 static const bool DBG_ONLY_PRINT_BITS_IN_READABLE_ORDER = true;
 static const bool DBG_SHOW_CURRENT_BITS = true;
 
-static struct TCell *first_memory_cell;
-static struct TGlobalCell *front_global_cell;
-static struct TLabel *first_label;
 static struct TCell *selected_cell;
-static struct TCell *prevCell;
-static struct TGlobalCell *back_global_cell;
-static struct TLabel *curr_label;
-static struct TIfElseStatement *current_if_else_statement;
 static struct TDebugState debug_state;
 static char *source_program_path;
 static char current_instruction;
-static long long int program_file_cursor_position = 0;
-static bool skip_instruction_because_of_if_else_statement;
+/* The source program stripped of comments and of every non-instruction
+ * character; it's the only thing the execution loop reads. */
+static char *program = NULL;
+static long long int program_length = 0;
+static long long int program_capacity = 0;
+static long long int program_counter = 0;
+/* "program" decoded for the threaded engine, plus a final return. */
+static struct TInstruction *decoded_program = NULL;
+/* Where the ':' of every label is in "program"; the label cursor is an index
+ * in it. */
+static long long int *labels = NULL;
+static long long int n_labels = 0;
+static long long int labels_capacity = 0;
+static long long int curr_label = 0;
+/* The library function, if any, that starts at each label. */
+static int *label_intrinsics = NULL;
+/* Computed by the loader: a false '?' or '"' jumps to its '!' or ';', and an
+ * executed '!' jumps to its ';'; IF_ELSE_JUMP_TO_ERROR marks a skip that
+ * runs into a misplaced else statement. */
+static long long int *if_else_jump_table = NULL;
+static const long long int IF_ELSE_JUMP_TO_ERROR = -1;
 static bool last_instruction_was_a_function_call = false;
 static bool last_instruction_was_a_return = false;
-static long long int n_nested_comments;
+/* Set by errors that terminate the whole program instead of the function. */
+static bool fatal_error = false;
 static bool show_usage = false;
-static short int error = OK;
 static bool debug = false;
-
-struct TBit {
-	BOOL1_T value;
-	/* "Null" bit value is determined by the parameter "next". */
-	struct TBit *next;
-	struct TBit *prev;
-};
-
-/* Memory cell. */
-struct TCell {
-	/* The first bit (front, LSB to MSB) always exists and is ignored; the
-	 * actual selected bit is therefore considered "selected_bit->next";
-	 * this is confusing but it allows to have just a boolean for the bit
-	 * value, decreasing memory usage in case you use a theoretical
-	 * processor or a virtual machine where "bool" is actually treated as
-	 * one single bit; the alternative would be an integer to account for
-	 * the "null" value. Using a "bit field" structure is also an option but
-	 * it's slower in computation and you can't fit the null value anyway.
-	 */
-	struct TBit ignored_starting_bit;
-
-	struct TBit *selected_bit;
-	struct TCell *next;
-	struct TCell *prev;
+static bool use_reference_loop = false;
+static bool use_jit = false;
+static bool emit_c = false;
+static bool use_intrinsics = true;
+
+/* With "-p", how many times every instruction of "program" has been run, and
+ * has skipped a block, by its position, and where in the source file it is;
+ * "profile_node" is the function running now, "profile_excess_depth" deep
+ * into calls past PROFILE_MAX_DEPTH. */
+static char *profile_path = NULL;
+static char *profile_source = NULL;
+static long long int profile_source_length = 0;
+static long long int *executions = NULL;
+static long long int *skips = NULL;
+static long long int *source_offsets = NULL;
+static long long int source_offsets_capacity = 0;
+static long long int *label_calls = NULL;
+static struct TProfileNode *profile_nodes = NULL;
+static long long int n_profile_nodes = 0;
+static long long int profile_nodes_capacity = 0;
+static long long int profile_node = 0;
+static long long int profile_depth = 0;
+static long long int profile_excess_depth = 0;
+
+static bool show_stats = false;
+#ifdef USE_STATS
+static struct TStats stats;
+#endif
+
+/* The files given with "-i" and "-o", if any. */
+static char *input_path = NULL;
+static char *output_path = NULL;
+
+#ifdef USE_JIT
+/* The machine code being compiled, with where the code of every position of
+ * "decoded_program" starts in it, if any; it's then copied to "jit_memory",
+ * and "jit_entry_points" points there instead. */
+static unsigned char *jit_code = NULL;
+static long long int jit_code_length = 0;
+static long long int jit_code_capacity = 0;
+static long long int *jit_offsets = NULL;
+static struct TJitJump *jit_jumps = NULL;
+static long long int n_jit_jumps = 0;
+static long long int jit_jumps_capacity = 0;
+/* The code that terminates the function with each error, the one of OK
+ * being for an error that has already been set, and the code that goes on
+ * from where a "jit_" function says. */
+static long long int jit_error_offsets[N_ERRORS];
+static long long int jit_resume_offset = 0;
+static bool jit_failed = false;
+static unsigned char *jit_memory = NULL;
+static size_t jit_memory_size = 0;
+static unsigned char **jit_entry_points = NULL;
+#endif
+
+/* The functions of the library as they are after loading, from their first
+ * label on; their calls are run natively, unless "-n" is given. */
+static const char *const INTRINSIC_BODIES[N_INTRINSICS] = {
+	[INTRINSIC_ADD] =
+	    ":&>&</:\">\">?>^#~!>#~;!<;;>>?_<<?>?>^>^!>^>_;!>?>^>_!>>^;;!"
+	    "<<?>?>^>_!>>^;!>?>>^!>>_;;;|+>+>>+<<<'",
+	[INTRINSIC_SUB] =
+	    ":&>&</:\">\">>#/@~!<;;>>?_<<?>?>^>^!>_>_;!>?>^>_!>^>^;;!<<?>"
+	    "?>>_!>>^;!>?>^>^!>>_;;;|+>+>>+<<<'",
+	[INTRINSIC_NORMALIZE] =
+	    ":&\"#~;/:?>^<;\"!+';>?<!<%_#~;/:?#~!*;-'",
+	[INTRINSIC_SHOW_BINARY] =
+	    ":&>_>^>^+_+_+_+^+^=>_+_+_+_+^+^=|:\"-/'!$>#>#@<&<+$////////'"
+	    ":>?!+\"~;=;$//#>#@<&<?>>>]!>>>>];|-$/////////'",
 };
 
-/* Memory cell of the global queue. */
-struct TGlobalCell {
-	/* The first bit always exists and is ignored; see TCell. */
-	struct TBit ignored_starting_bit;
-
-	struct TGlobalCell *next;
+/* An instruction of the decoded program; the next one is "length" positions
+ * after it. "operand" is where a '?', '"' or '!' skips to, as in
+ * "if_else_jump_table", how far a run of moves goes, the label a label move
+ * selects or where a jump or call goes to; "reach" is the
+ * farthest bit that a run of '+' and '-' gets to, or the label of a direct
+ * jump or call. A literal store sets the
+ * cell to the "reach" bits of "value" and selects the bit "operand", and a
+ * character output prints "operand". The instruction acts on the
+ * cell "offset" cells after the selected one, once the cursor has been moved
+ * forward by "move" cells. */
+struct TInstruction {
+#ifdef USE_COMPUTED_GOTO
+	const void *handler;
+#endif
+	int opcode;
+	long long int length;
+	long long int operand;
+	long long int reach;
+	long long int offset;
+	long long int move;
+	uint64_t value;
 };
 
-struct TLabel {
-	long long int file_pos;
-	struct TLabel *next;
-	struct TLabel *prev;
+/* What literal folding knows of the cell "offset" cells after the selected
+ * one: its value, if "known", and whether the instructions that gave it that
+ * value have been removed, so that it's still to be stored. */
+struct TLiteral {
+	long long int offset;
+	bool known;
+	bool pending;
+	uint64_t value;
+	long long int length;
+	long long int selected_bit;
 };
 
-struct TIfElseStatement {
-	bool skip_this_block;
-	enum condition_types type;
-	bool condition_result;
-	struct TIfElseStatement *next_nested;
-	struct TIfElseStatement *prev_nested;
+#ifdef USE_JIT
+/* A jump of the machine code to the instruction at "pos", which may not have
+ * been compiled yet. */
+struct TJitJump {
+	long long int at;
+	long long int pos;
 };
+#endif
 
 struct TDebugState {
-	struct TCell *dbg_current_cell;
-	struct TGlobalCell *dbg_curr_global_cell;
 	bool instr_has_immediate_effect_in_memory;
 };
 
-bool
-my_strcpy(char *destination, char *source, size_t max_length)
-{
-	size_t srclen = strlen(source);
-	if (srclen + 1 < max_length) {
-		memcpy(destination, source, srclen + 1);
-		return 0;
-	} else {
-		error = ERR_STRING_TOO_LONG;
-		return 1;
-	}
-}
+/* A function as called from another one, down from the main function, whose
+ * "label" is -1; "-p" counts the instructions run in each one. */
+struct TProfileNode {
+	long long int label;
+	long long int parent;
+	long long int first_child;
+	long long int next_sibling;
+	long long int n_instructions;
+};
+
+/* What "-s" reports, besides "bx_memory_stats": how many times each
+ * instruction has been run, by its character, the calls and the jumps, and
+ * the most nested calls and cells that the program has had at once. */
+#ifdef USE_STATS
+struct TStats {
+	long long int instructions[256];
+	long long int calls;
+	long long int max_call_depth;
+	long long int jumps;
+	long long int max_cells;
+};
+#endif
 
 int
 process_arguments(int argc, char *argv[])
@@ -194,17 +462,81 @@ process_arguments(int argc, char *argv[])
 	opterr = 0;
 	int non_option_argc;
 
-	static struct option long_options[] = {
-	    {"debug", no_argument, NULL, 'd'}, {NULL, 0, NULL, 0}};
+	char *max_call_depth_arg = NULL;
+	char *end;
 
-	while ((c = getopt_long(argc, argv, "d", long_options, NULL)) != -1) {
+	static struct option long_options[] = {
+	    {"async_output", no_argument, NULL, 'a'},
+	    {"debug", no_argument, NULL, 'd'},
+	    {"emit_c", no_argument, NULL, 'c'},
+	    {"input", required_argument, NULL, 'i'},
+	    {"jit", no_argument, NULL, 'j'},
+	    {"max_call_depth", required_argument, NULL, 'm'},
+	    {"no_intrinsics", no_argument, NULL, 'n'},
+	    {"output", required_argument, NULL, 'o'},
+	    {"profile", required_argument, NULL, 'p'},
+	    {"stats", no_argument, NULL, 's'},
+	    {"reference_loop", no_argument, NULL, 'r'},
+	    {NULL, 0, NULL, 0}};
+
+	while ((c = getopt_long(
+		    argc, argv, "acdi:jm:no:p:rs", long_options, NULL)) != -1) {
 		switch (c) {
+		case 'a': {
+			bx_async_output = true;
+			break;
+		}
+		case 'c': {
+			emit_c = true;
+			break;
+		}
 		case 'd': {
 			debug = true;
 			break;
 		}
+		case 'i': {
+			input_path = optarg;
+			break;
+		}
+		case 'j': {
+			use_jit = true;
+			break;
+		}
+		case 'm': {
+			max_call_depth_arg = optarg;
+			break;
+		}
+		case 'n': {
+			use_intrinsics = false;
+			break;
+		}
+		case 'o': {
+			output_path = optarg;
+			break;
+		}
+		case 'p': {
+			profile_path = optarg;
+			break;
+		}
+		case 's': {
+#ifdef USE_STATS
+			show_stats = true;
+			bx_count_memory = true;
+#endif
+			break;
+		}
+		case 'r': {
+			use_reference_loop = true;
+			break;
+		}
 		case '?': {
-			if (isprint(optopt)) {
+			if (optopt == 'i' || optopt == 'm' || optopt == 'o' ||
+			    optopt == 'p') {
+				fprintf(
+				    stderr,
+				    "Option -%c requires an argument.\n",
+				    optopt);
+			} else if (isprint(optopt)) {
 				fprintf(
 				    stderr, "Unknown option `-%c'.\n", optopt);
 			} else {
@@ -221,6 +553,17 @@ process_arguments(int argc, char *argv[])
 		}
 	}
 
+	if (max_call_depth_arg != NULL) {
+		bx_max_call_depth = strtoll(max_call_depth_arg, &end, 10);
+		if (*end != '\0' || end == max_call_depth_arg ||
+		    bx_max_call_depth < 0) {
+			fprintf(
+			    stderr,
+			    "Option '-m' has been given a bad value.\n");
+			return 1;
+		}
+	}
+
 	non_option_argc = argc - optind;
 
 	if (non_option_argc == 0) {
@@ -235,592 +578,3007 @@ process_arguments(int argc, char *argv[])
 	}
 }
 
-void
-register_all_labels(FILE *source_program)
+/* Opens the files given with "-i" and "-o", if any; a regular input file is
+ * mapped in memory as a whole. */
+bool
+open_input_and_output()
 {
-	while (fscanf(source_program, "%1c", &current_instruction) == 1) {
-		if (current_instruction == '{') {
-			n_nested_comments++;
-		} else if (
-		    current_instruction == '}' && n_nested_comments > 0) {
-			n_nested_comments--;
+	if (input_path != NULL) {
+		bx_input_fd = open(input_path, O_RDONLY);
+		if (bx_input_fd < 0) {
+			fprintf(stderr, "Can't open the input file.\n");
+			return false;
 		}
+		bx_map_input();
+	}
 
-		if (n_nested_comments == 0) {
-			if (current_instruction == ':') {
-				/* Register a new label. */
-				struct TLabel *new_label =
-				    malloc(sizeof(struct TLabel));
-				new_label->next = NULL;
-				new_label->file_pos =
-				    program_file_cursor_position;
-
-				/* Update pointers. */
-				if (first_label == NULL) {
-					first_label = new_label;
-					curr_label = new_label;
-					new_label->prev = NULL;
-				} else {
-					curr_label->next = new_label;
-					new_label->prev = curr_label;
-					curr_label = new_label;
-				}
-			}
+	if (output_path != NULL) {
+		bx_output_fd =
+		    open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (bx_output_fd < 0) {
+			fprintf(stderr, "Can't open the output file.\n");
+			close_input_and_output();
+			return false;
 		}
-		program_file_cursor_position++;
 	}
+
+	return true;
 }
 
 void
-execute_source_program_function(FILE *source_program, long long int from_pos)
+close_input_and_output()
 {
-	struct TCell cells;
-	struct TCell *backup_pointer_of_the_selected_cell;
-	struct TIfElseStatement *backup_pointer_of_current_if_else_statement;
-	long long int backup_source_program_pos;
-
-	first_memory_cell = &cells;
-	selected_cell = first_memory_cell;
-	selected_cell->ignored_starting_bit.next = NULL;
-	selected_cell->ignored_starting_bit.prev = NULL;
-	selected_cell->selected_bit = &selected_cell->ignored_starting_bit;
-	selected_cell->next = NULL;
-	selected_cell->prev = NULL;
-	current_if_else_statement = NULL;
-	skip_instruction_because_of_if_else_statement = false;
-
-	/* Start from a given position. */
-	if (fseek(source_program, from_pos, SEEK_SET) != 0) {
-		error = ERR_SEEK_PROGRAM_POSITION;
-		process_errors();
-		free_local_function_memory();
-		clear_if_else_statements();
-		return;
+	if (input_path != NULL && bx_input_fd >= 0) {
+		bx_unmap_input();
+		close(bx_input_fd);
 	}
+	if (output_path != NULL && bx_output_fd >= 0) {
+		close(bx_output_fd);
+	}
+}
 
-	/* Read the instructions one by one. */
-	while (fscanf(source_program, "%1c", &current_instruction) == 1) {
-		dbg_print_instruction();
+/* A regular file is mapped in memory and read straight from there; anything
+ * else is read in blocks. */
+void
+load_source_program(int source_program)
+{
+	static char buffer[SOURCE_BUFFER_SIZE];
+	struct stat source_stat;
+	char *source = MAP_FAILED;
+	ssize_t n_read;
+	long long int n_nested_comments = 0;
+
+	if (fstat(source_program, &source_stat) == 0 &&
+	    S_ISREG(source_stat.st_mode) && source_stat.st_size > 0) {
+		source = mmap(
+		    NULL, source_stat.st_size, PROT_READ, MAP_PRIVATE,
+		    source_program, 0);
+	}
 
-		if (current_instruction == '{') {
-			n_nested_comments++;
-			continue;
-		} else if (current_instruction == '}') {
-			n_nested_comments--;
-			continue;
+	if (source != MAP_FAILED) {
+		madvise(source, source_stat.st_size, MADV_SEQUENTIAL);
+		strip_source_program(
+		    source, source_stat.st_size, &n_nested_comments);
+		munmap(source, source_stat.st_size);
+	} else {
+		while ((n_read = read(
+			    source_program, buffer, SOURCE_BUFFER_SIZE)) != 0) {
+			if (n_read < 0 && errno == EINTR) {
+				continue;
+			} else if (n_read < 0) {
+				bx_error = ERR_READ_SOURCE_PROGRAM;
+				return;
+			}
+			strip_source_program(
+			    buffer, n_read, &n_nested_comments);
 		}
+	}
+
+	build_if_else_jump_table();
+	decode_program();
+}
 
-		if (n_nested_comments > 0) {
+/* Strip comments and every other non-instruction character once, and register
+ * the labels by their position in the stripped program; "n_nested_comments"
+ * carries over from a block of the source to the next one. */
+void
+strip_source_program(
+    const char *source, long long int length,
+    long long int *n_nested_comments)
+{
+	struct TTokens tokens;
+	uint64_t wanted;
+	long long int n;
+	long long int i;
+
+	for (long long int start = 0; start < length;
+	     start += TOKENIZER_BLOCK_SIZE) {
+		n = length - start < TOKENIZER_BLOCK_SIZE
+			? length - start
+			: TOKENIZER_BLOCK_SIZE;
+		tokenize_block(source + start, n, &tokens);
+		wanted = tokens.comment_starts | tokens.comment_ends;
+		if (wanted == 0 && *n_nested_comments > 0) {
 			continue;
 		}
 
-		process_current_instruction(source_program);
-
-		if (error != OK) {
-			process_errors();
-			free_local_function_memory();
-			clear_if_else_statements();
-			return;
-		} else if (last_instruction_was_a_function_call) {
-			last_instruction_was_a_function_call = false;
-			if (first_label == NULL) {
-				error = ERR_JUMP_BUT_NO_LABEL;
-				process_errors();
-				free_local_function_memory();
-				clear_if_else_statements();
-				return;
+		wanted |= tokens.instructions;
+		while (wanted != 0) {
+			i = next_token(&wanted);
+			if (tokens.comment_starts >> i & 1) {
+				(*n_nested_comments)++;
+				continue;
+			} else if (tokens.comment_ends >> i & 1) {
+				if (*n_nested_comments > 0) {
+					(*n_nested_comments)--;
+				}
+				continue;
+			}
+			if (*n_nested_comments > 0) {
+				continue;
 			}
 
-			/* Backup. */
-			backup_source_program_pos = ftell(source_program);
-			backup_pointer_of_the_selected_cell = selected_cell;
-			backup_pointer_of_current_if_else_statement =
-			    current_if_else_statement;
-
-			/* Call another function. */
-			execute_source_program_function(
-			    source_program, curr_label->file_pos);
-
-			/* Restore. */
-			fseek(
-			    source_program, backup_source_program_pos,
-			    SEEK_SET);
-			first_memory_cell = &cells;
-			selected_cell = backup_pointer_of_the_selected_cell;
-			current_if_else_statement =
-			    backup_pointer_of_current_if_else_statement;
-
-		} else if (last_instruction_was_a_return) {
-			last_instruction_was_a_return = false;
-
-			/* Terminate this function. */
-			free_local_function_memory();
-			clear_if_else_statements();
-			return;
+			if (tokens.labels >> i & 1) {
+				/* Register a new label. */
+				append_label(program_length);
+			}
+			if (profile_path != NULL) {
+				record_source_offset(
+				    profile_source_length + start + i);
+			}
+			append_instruction(source[start + i]);
 		}
-
-		dbg_print_stack_info();
 	}
-	free_local_function_memory();
-	clear_if_else_statements();
+	if (profile_path != NULL) {
+		keep_profile_source(source, length);
+	}
 }
 
 void
-process_current_instruction(FILE *source_program)
+append_instruction(char instruction)
 {
-	/* Check if it's an if-else instruction. */
-	switch (current_instruction) {
-	case '?': {
-		instruction_if_condition_equal_to_1();
-		break;
-	}
-	case '"': {
-		instruction_if_condition_equal_to_null();
-		break;
-	}
-	case '!': {
-		instruction_else_condition();
-		break;
-	}
-	case ';': {
-		instruction_end_of_if_else_statement();
-		break;
-	}
+	if (program_length == program_capacity) {
+		program_capacity =
+		    program_capacity == 0 ? 4096 : program_capacity * 2;
+		program = realloc(program, program_capacity);
 	}
+	program[program_length++] = instruction;
+}
 
-	skip_instruction_because_of_if_else_statement = true;
-	if (current_if_else_statement == NULL) {
-		skip_instruction_because_of_if_else_statement = false;
-	} else if (
-	    current_if_else_statement->skip_this_block == false &&
-	    current_if_else_statement->condition_result == true) {
-		skip_instruction_because_of_if_else_statement = false;
+void
+append_label(long long int program_pos)
+{
+	if (n_labels == labels_capacity) {
+		labels_capacity =
+		    labels_capacity == 0 ? 64 : labels_capacity * 2;
+		labels =
+		    realloc(labels, labels_capacity * sizeof(long long int));
 	}
-	if (skip_instruction_because_of_if_else_statement == false) {
-		/* Check for other types of instruction. */
-		switch (current_instruction) {
-		case '>': {
-			instruction_go_to_next_cell();
+	labels[n_labels++] = program_pos;
+}
+
+void
+build_if_else_jump_table()
+{
+	/* The '?', '"' or '!' still waiting for its target, one per nesting
+	 * level. */
+	long long int *open_statements = NULL;
+	long long int open_statements_capacity = 0;
+	long long int depth = 0;
+	long long int top;
+	const long long int UNRESOLVED = -2;
+
+	if_else_jump_table = malloc(
+	    (program_length > 0 ? program_length : 1) * sizeof(long long int));
+
+	for (long long int pos = 0; pos < program_length; pos++) {
+		switch (program[pos]) {
+		case '?':
+		case '"': {
+			if (depth == open_statements_capacity) {
+				open_statements_capacity =
+				    open_statements_capacity == 0
+					? 64
+					: open_statements_capacity * 2;
+				open_statements = realloc(
+				    open_statements,
+				    open_statements_capacity *
+					sizeof(long long int));
+			}
+			if_else_jump_table[pos] = UNRESOLVED;
+			open_statements[depth++] = pos;
+			if (depth > bx_if_else_max_depth) {
+				bx_if_else_max_depth = depth;
+			}
 			break;
 		}
-		case '<': {
-			instruction_go_to_previous_cell();
+		case '!': {
+			if_else_jump_table[pos] = UNRESOLVED;
+			if (depth == 0) {
+				/* Always misplaced, the runtime will tell. */
+				break;
+			}
+			top = open_statements[depth - 1];
+			if (program[top] == '!') {
+				/* A second else statement: every skip which
+				 * gets here, from this level or from the
+				 * outer ones, ends with an error. The outer
+				 * statements that already have a target had
+				 * it set this same way, and so did all the
+				 * ones below them. */
+				for (long long int i = depth - 1; i >= 0; i--) {
+					if (if_else_jump_table
+						[open_statements[i]] !=
+					    UNRESOLVED) {
+						break;
+					}
+					if_else_jump_table[open_statements[i]] =
+					    IF_ELSE_JUMP_TO_ERROR;
+				}
+			} else if (if_else_jump_table[top] == UNRESOLVED) {
+				if_else_jump_table[top] = pos;
+			}
+			open_statements[depth - 1] = pos;
 			break;
 		}
-		case '+': {
-			instruction_go_to_next_bit();
+		case ';': {
+			if (depth == 0) {
+				break;
+			}
+			top = open_statements[--depth];
+			if (if_else_jump_table[top] == UNRESOLVED) {
+				if_else_jump_table[top] = pos;
+			}
 			break;
 		}
-		case '-': {
-			instruction_go_to_previous_bit();
-			break;
 		}
-		case '|': {
-			instruction_go_to_first_cell();
-			break;
+	}
+
+	/* Statements never closed skip to the end of the program. */
+	for (long long int i = 0; i < depth; i++) {
+		if (if_else_jump_table[open_statements[i]] == UNRESOLVED) {
+			if_else_jump_table[open_statements[i]] = program_length;
 		}
-		case '=': {
-			instruction_go_to_first_bit();
+	}
+	free(open_statements);
+}
+
+void
+decode_program()
+{
+	struct TInstruction *instruction;
+
+	decoded_program =
+	    malloc((program_length + 1) * sizeof(struct TInstruction));
+	for (long long int pos = 0; pos <= program_length; pos++) {
+		instruction = &decoded_program[pos];
+		instruction->length = 1;
+		instruction->operand = 0;
+		instruction->reach = 0;
+		instruction->offset = 0;
+		instruction->move = 0;
+		instruction->value = 0;
+		if (pos == program_length) {
+			instruction->opcode = OP_RETURN;
 			break;
 		}
-		case '_': {
-			instruction_set_bit_to_zero();
+		switch (program[pos]) {
+		case '>':
+			instruction->opcode = OP_NEXT_CELL;
 			break;
-		}
-		case '^': {
-			instruction_set_bit_to_one();
+		case '<':
+			instruction->opcode = OP_PREVIOUS_CELL;
 			break;
-		}
-		case '*': {
-			instruction_set_bit_to_null();
+		case '|':
+			instruction->opcode = OP_FIRST_CELL;
 			break;
-		}
-		case '%': {
-			instruction_set_all_bits_to_null_and_go_to_first_bit();
+		case '+':
+			instruction->opcode = OP_NEXT_BIT;
 			break;
-		}
-		case ']': {
-			instruction_print_cell_value_as_ASCII_character();
+		case '-':
+			instruction->opcode = OP_PREVIOUS_BIT;
 			break;
-		}
-		case '[': {
-			instruction_get_ASCII_input_and_save_as_cell_value();
+		case '=':
+			instruction->opcode = OP_FIRST_BIT;
 			break;
-		}
-		case '#': {
-			instruction_global_queue_enqueue();
+		case '_':
+			instruction->opcode = OP_SET_BIT_TO_ZERO;
 			break;
-		}
-		case '&': {
-			instruction_global_queue_dequeue();
+		case '^':
+			instruction->opcode = OP_SET_BIT_TO_ONE;
 			break;
-		}
-		case '@': {
-			instruction_call_function();
+		case '*':
+			instruction->opcode = OP_SET_BIT_TO_NULL;
 			break;
-		}
-		case '\'': {
-			instruction_jump_to_label(source_program);
+		case '%':
+			instruction->opcode = OP_SET_ALL_BITS_TO_NULL;
 			break;
-		}
-		case '/': {
-			instruction_select_next_label();
+		case ']':
+			instruction->opcode = OP_OUTPUT;
 			break;
-		}
-		case '\\': {
-			instruction_select_previous_label();
+		case '[':
+			instruction->opcode = OP_INPUT;
 			break;
-		}
-		case '$': {
-			instruction_select_first_label();
+		case '#':
+			instruction->opcode = OP_ENQUEUE;
 			break;
-		}
-		case '~': {
-			instruction_return();
+		case '&':
+			instruction->opcode = OP_DEQUEUE;
+			break;
+		case '?':
+			instruction->opcode = OP_IF_EQUAL_TO_1;
+			instruction->operand = if_else_jump_table[pos];
+			break;
+		case '"':
+			instruction->opcode = OP_IF_EQUAL_TO_NULL;
+			instruction->operand = if_else_jump_table[pos];
+			break;
+		case '!':
+			instruction->opcode = OP_ELSE;
+			instruction->operand = if_else_jump_table[pos];
+			break;
+		case ';':
+			instruction->opcode = OP_END_IF;
+			break;
+		case ':':
+			instruction->opcode = OP_LABEL;
+			break;
+		case '/':
+			instruction->opcode = OP_NEXT_LABEL;
+			break;
+		case '\\':
+			instruction->opcode = OP_PREVIOUS_LABEL;
+			break;
+		case '$':
+			instruction->opcode = OP_FIRST_LABEL;
+			break;
+		case '\'':
+			instruction->opcode = OP_JUMP;
+			break;
+		case '@':
+			instruction->opcode = OP_CALL;
+			break;
+		case '~':
+			instruction->opcode = OP_RETURN;
 			break;
 		}
-		}
-	}
-}
-
-void
-instruction_if_condition_common()
-{
-	if (current_if_else_statement == NULL) {
-		/* Create the first if-else statement. */
-		current_if_else_statement =
-		    malloc(sizeof(struct TIfElseStatement));
-		current_if_else_statement->skip_this_block = false;
-		current_if_else_statement->next_nested = NULL;
-		current_if_else_statement->prev_nested = NULL;
-	} else {
-		/* Create a nested if-else statement. */
-		struct TIfElseStatement *new_nested_child =
-		    malloc(sizeof(struct TIfElseStatement));
-		current_if_else_statement->next_nested = new_nested_child;
-
-		/* This new if-else statement can only be executed if the parent
-		 * is being executed. */
-		if (current_if_else_statement->condition_result == true &&
-		    current_if_else_statement->skip_this_block == false) {
-			new_nested_child->skip_this_block = false;
-		} else
-			new_nested_child->skip_this_block = true;
-
-		new_nested_child->next_nested = NULL;
-		new_nested_child->prev_nested = current_if_else_statement;
-
-		/* Make the child the current one. */
-		current_if_else_statement = new_nested_child;
 	}
 
-	current_if_else_statement->type = CONDITION_IF;
-}
-
-void
-instruction_if_condition_equal_to_1()
-{
-	instruction_if_condition_common();
-
-	current_if_else_statement->condition_result = false;
-
-	if (selected_cell->selected_bit->next == NULL) {
-		current_if_else_statement->condition_result = false;
-	} else {
-		if (selected_cell->selected_bit->next->value == true) {
-			current_if_else_statement->condition_result = true;
-		} else {
-			current_if_else_statement->condition_result = false;
+	for (long long int pos = 0; pos < program_length;) {
+		switch (program[pos]) {
+		case '>':
+		case '<':
+		case '+':
+		case '-':
+		case '/':
+		case '\\':
+			pos = fuse_moves(pos);
+			break;
+		default:
+			pos++;
 		}
 	}
-}
-
-void
-instruction_if_condition_equal_to_null()
-{
-	instruction_if_condition_common();
-
-	current_if_else_statement->condition_result = false;
 
-	if (selected_cell->selected_bit->next == NULL) {
-		current_if_else_statement->condition_result = true;
-	} else {
-		current_if_else_statement->condition_result = false;
+	resolve_labels();
+	address_cells_by_offset();
+	fold_literals();
+	find_bit_scans();
+	if (use_intrinsics && emit_c == false) {
+		find_intrinsics();
 	}
 }
 
-void
-instruction_else_condition()
+/* Turn the run of moves starting at "pos" into as few instructions as
+ * possible, each one stored at the start of the moves it stands for; the
+ * other positions are never jumped to, since they don't follow a ':', '!',
+ * ';' or '@'. Returns where the run ends. */
+long long int
+fuse_moves(long long int pos)
 {
-	if (current_if_else_statement == NULL) {
-		error = ERR_MISPLACED_ELSE;
-		return;
-	} else {
-		if (current_if_else_statement->type != CONDITION_IF) {
-			error = ERR_MISPLACED_ELSE;
-		} else {
-			current_if_else_statement->type = CONDITION_ELSE;
-			current_if_else_statement->condition_result =
-			    !current_if_else_statement->condition_result;
+	struct TInstruction *instruction = &decoded_program[pos];
+	char forward = program[pos] == '>' || program[pos] == '<' ? '>' : '+';
+	char backward = forward == '>' ? '<' : '-';
+	long long int end = pos;
+	long long int distance = 0;
+	long long int reach = 0;
+
+	if (program[pos] == '/' || program[pos] == '\\' ||
+	    program[pos] == backward) {
+		/* Only the same move, as going back stops at the start and a
+		 * label cursor that goes too far stops the function. */
+		while (end < program_length && program[end] == program[pos]) {
+			end++;
 		}
+		instruction->length = end - pos;
+		instruction->operand = end - pos;
+		return end;
 	}
-}
 
-void
-instruction_end_of_if_else_statement()
-{
-	if (current_if_else_statement == NULL) {
-		error = ERR_END_IF;
-	} else {
-		if (current_if_else_statement->prev_nested == NULL) {
-			free(current_if_else_statement);
-			current_if_else_statement = NULL;
+	/* Forward and backward moves, as long as they don't go back past where
+	 * they started: from there, every bit or cell they pass over is after
+	 * the starting one. */
+	while (end < program_length) {
+		if (program[end] == forward) {
+			distance++;
+		} else if (program[end] == backward && distance > 0) {
+			distance--;
 		} else {
-			struct TIfElseStatement *statement_to_delete =
-			    current_if_else_statement;
-			current_if_else_statement =
-			    current_if_else_statement->prev_nested;
-			current_if_else_statement->next_nested = NULL;
-			free(statement_to_delete);
+			break;
 		}
+		if (distance > reach) {
+			reach = distance;
+		}
+		end++;
 	}
-}
-
-void
-instruction_go_to_next_cell()
-{
-	if (selected_cell->next == NULL) {
-		prevCell = selected_cell;
-		selected_cell->next = malloc(sizeof(struct TCell));
-		selected_cell = selected_cell->next;
-		selected_cell->next = NULL;
-		selected_cell->prev = prevCell;
-		selected_cell->selected_bit =
-		    &selected_cell->ignored_starting_bit;
-		selected_cell->selected_bit->next = NULL;
-		selected_cell->selected_bit->prev = NULL;
-	} else {
-		selected_cell = selected_cell->next;
+	instruction->length = end - pos;
+	instruction->operand = distance;
+	instruction->reach = reach;
+	if (forward == '>' && distance == 0) {
+		/* No cell gets changed by just being passed over. */
+		instruction->opcode = OP_NOP;
 	}
+	return end;
 }
 
+/* Follow the label cursor through the program, before running it: a label
+ * move from a known label selects another known label, and a jump or call from
+ * a known label goes straight to it. The cursor is known at the start of the
+ * program and after a jump or call to a label, which leave it on that label;
+ * it's unknown after a call returns, and where different ways into the same
+ * instruction bring different labels. */
 void
-instruction_go_to_previous_cell()
+resolve_labels()
 {
-	if (selected_cell->prev != NULL) {
-		selected_cell = selected_cell->prev;
+	/* What the skips of the if-else statements bring to each position. */
+	long long int *skipped_to;
+	const long long int UNKNOWN = -1;
+	const long long int UNREACHED = -2;
+	long long int cursor = 0;
+	long long int entered_label = -1;
+	long long int last_select = -1;
+	long long int next_pos;
+	long long int target;
+	struct TInstruction *instruction;
+
+	if (n_labels == 0) {
+		return;
+	}
+	skipped_to = malloc((program_length + 1) * sizeof(long long int));
+	for (long long int pos = 0; pos <= program_length; pos++) {
+		skipped_to[pos] = UNREACHED;
 	}
-}
 
-void
-instruction_go_to_next_bit()
-{
-	struct TBit *prev_bit;
+	for (long long int pos = 0; pos < program_length; pos = next_pos) {
+		instruction = &decoded_program[pos];
+		next_pos = pos + instruction->length;
 
-	if (selected_cell->selected_bit->next == NULL) {
-		prev_bit = selected_cell->selected_bit;
-		selected_cell->selected_bit->next = malloc(sizeof(struct TBit));
-		selected_cell->selected_bit = selected_cell->selected_bit->next;
-		selected_cell->selected_bit->value = false;
-		selected_cell->selected_bit->next = NULL;
-		selected_cell->selected_bit->prev = prev_bit;
-	} else {
-		selected_cell->selected_bit = selected_cell->selected_bit->next;
-	}
-}
+		/* Every way into this position. */
+		if (cursor == UNREACHED || cursor == skipped_to[pos]) {
+			cursor = skipped_to[pos];
+		} else if (skipped_to[pos] != UNREACHED) {
+			cursor = UNKNOWN;
+		}
+		if (pos > 0 && program[pos - 1] == ':') {
+			if (cursor == UNREACHED) {
+				cursor = entered_label;
+			} else if (cursor != entered_label) {
+				cursor = UNKNOWN;
+			}
+		}
+		if (cursor < 0) {
+			last_select = -1;
+		}
 
-void
-instruction_go_to_previous_bit()
-{
-	if (selected_cell->selected_bit->prev != NULL) {
-		selected_cell->selected_bit = selected_cell->selected_bit->prev;
+		switch (instruction->opcode) {
+		case OP_FIRST_LABEL:
+		case OP_NEXT_LABEL:
+		case OP_PREVIOUS_LABEL: {
+			if (instruction->opcode == OP_FIRST_LABEL) {
+				target = 0;
+			} else if (cursor < 0) {
+				target = UNKNOWN;
+			} else if (instruction->opcode == OP_NEXT_LABEL) {
+				target = cursor + instruction->operand;
+			} else {
+				target = cursor - instruction->operand;
+			}
+			if (target < 0 || target >= n_labels) {
+				/* Left to the runtime, or to its error. */
+				cursor = UNKNOWN;
+				last_select = -1;
+				break;
+			}
+			if (last_select >= 0) {
+				/* Selected again before being used. */
+				decoded_program[last_select].opcode = OP_NOP;
+			}
+			instruction->opcode = OP_SELECT_LABEL;
+			instruction->operand = target;
+			cursor = target;
+			last_select = pos;
+			continue;
+		}
+		case OP_JUMP:
+		case OP_CALL: {
+			if (cursor >= 0 && instruction->opcode == OP_JUMP) {
+				instruction->opcode = OP_DIRECT_JUMP;
+			} else if (cursor >= 0) {
+				instruction->opcode = OP_DIRECT_CALL;
+			}
+			if (cursor >= 0) {
+				/* Straight after the ':'. */
+				instruction->operand = labels[cursor] + 1;
+				instruction->reach = cursor;
+			}
+			/* A call returns from who knows where. */
+			cursor =
+			    instruction->opcode == OP_CALL ||
+				    instruction->opcode == OP_DIRECT_CALL
+				? UNKNOWN
+				: UNREACHED;
+			break;
+		}
+		case OP_RETURN: {
+			cursor = UNREACHED;
+			break;
+		}
+		case OP_IF_EQUAL_TO_1:
+		case OP_IF_EQUAL_TO_NULL:
+		case OP_ELSE: {
+			/* A misplaced else statement has no target. */
+			target = instruction->operand;
+			if (target >= 0 && target != program_length) {
+				if (skipped_to[target + 1] == UNREACHED ||
+				    skipped_to[target + 1] == cursor) {
+					skipped_to[target + 1] = cursor;
+				} else if (cursor != UNREACHED) {
+					skipped_to[target + 1] = UNKNOWN;
+				}
+			}
+			if (instruction->opcode == OP_ELSE) {
+				/* It always skips, or ends in an error. */
+				cursor = UNREACHED;
+			}
+			break;
+		}
+		case OP_LABEL: {
+			entered_label++;
+			break;
+		}
+		}
+		last_select = -1;
 	}
+	free(skipped_to);
 }
 
+/* Leave the cell cursor where it is while a straight piece of the program
+ * moves it around, and have every instruction act on the cell at the right
+ * distance from it instead; the moves are dropped, and the cursor is only
+ * moved by the instructions after which the program could go on from
+ * elsewhere. An if-else statement is part of the piece when all of its
+ * blocks leave the cursor where they found it. The instructions left are
+ * packed towards the start of their piece, which is only ever entered from
+ * its start: the position after a ':', '!', ';' or '@'. */
 void
-instruction_go_to_first_cell()
+address_cells_by_offset()
 {
-	selected_cell = first_memory_cell;
-}
+	struct TInstruction instruction;
+	long long int next_pos;
+	long long int offset = 0;
+	long long int balanced_end = -1;
+	long long int write_pos = 0;
+	long long int last_written = -1;
+	char previous;
+
+	for (long long int pos = 0; pos <= program_length; pos = next_pos) {
+		previous = pos > 0 ? program[pos - 1] : '\0';
+		if (pos == program_length || previous == ':' ||
+		    previous == '!' || previous == ';' || previous == '@') {
+			/* The end of a piece. */
+			if (last_written >= 0) {
+				decoded_program[last_written].length =
+				    pos - last_written;
+			} else if (write_pos < pos) {
+				/* Nothing left but moves. */
+				decoded_program[write_pos].opcode = OP_NOP;
+				decoded_program[write_pos].length =
+				    pos - write_pos;
+			}
+			if (pos == program_length) {
+				break;
+			}
+			write_pos = pos;
+			last_written = -1;
+		}
+
+		instruction = decoded_program[pos];
+		next_pos = pos + instruction.length;
+		instruction.length = 1;
+
+		switch (instruction.opcode) {
+		case OP_NEXT_CELL: {
+			offset += instruction.operand;
+			continue;
+		}
+		case OP_NOP: {
+			continue;
+		}
+		case OP_PREVIOUS_CELL: {
+			if (offset >= instruction.operand) {
+				offset -= instruction.operand;
+				continue;
+			}
+			/* It could stop at the first cell. */
+			instruction.operand -= offset;
+			offset = 0;
+			break;
+		}
+		case OP_FIRST_CELL:
+		case OP_RETURN: {
+			offset = 0;
+			break;
+		}
+		case OP_LABEL:
+		case OP_CALL:
+		case OP_JUMP:
+		case OP_DIRECT_CALL:
+		case OP_DIRECT_JUMP: {
+			instruction.move = offset;
+			offset = 0;
+			break;
+		}
+		case OP_IF_EQUAL_TO_1:
+		case OP_IF_EQUAL_TO_NULL: {
+			if (pos > balanced_end) {
+				balanced_end =
+				    balanced_statement_end(pos, offset);
+			}
+			if (pos < balanced_end) {
+				instruction.offset = offset;
+			} else {
+				instruction.move = offset;
+				offset = 0;
+			}
+			break;
+		}
+		case OP_ELSE:
+		case OP_END_IF: {
+			if (pos > balanced_end) {
+				instruction.move = offset;
+				offset = 0;
+			}
+			break;
+		}
+		default: {
+			instruction.offset = offset;
+		}
+		}
+
+		decoded_program[write_pos] = instruction;
+		last_written = write_pos++;
+	}
+}
+
+/* Where the if-else statement starting at "pos" ends, if none of its blocks
+ * moves the cell cursor back past the cell "offset" cells after the selected
+ * one, nor leaves it elsewhere, nor goes on elsewhere; -1 otherwise. */
+long long int
+balanced_statement_end(long long int pos, long long int offset)
+{
+	/* Where the cursor was at the start of each open statement. */
+	long long int *starts =
+	    malloc(bx_if_else_max_depth * sizeof(long long int));
+	long long int depth = 0;
+	long long int end = -1;
+	struct TInstruction *instruction;
+
+	while (pos < program_length && end == -1) {
+		instruction = &decoded_program[pos];
+		pos += instruction->length;
+
+		switch (instruction->opcode) {
+		case OP_NEXT_CELL: {
+			offset += instruction->operand;
+			break;
+		}
+		case OP_PREVIOUS_CELL: {
+			if (offset < instruction->operand) {
+				pos = program_length;
+			}
+			offset -= instruction->operand;
+			break;
+		}
+		case OP_FIRST_CELL:
+		case OP_LABEL:
+		case OP_JUMP:
+		case OP_CALL:
+		case OP_DIRECT_JUMP:
+		case OP_DIRECT_CALL:
+		case OP_RETURN: {
+			pos = program_length;
+			break;
+		}
+		case OP_IF_EQUAL_TO_1:
+		case OP_IF_EQUAL_TO_NULL: {
+			starts[depth++] = offset;
+			break;
+		}
+		case OP_ELSE: {
+			if (offset != starts[depth - 1]) {
+				pos = program_length;
+			}
+			break;
+		}
+		case OP_END_IF: {
+			if (offset != starts[--depth]) {
+				pos = program_length;
+			} else if (depth == 0) {
+				end = pos - 1;
+			}
+			break;
+		}
+		}
+	}
+	free(starts);
+	return end;
+}
+
+/* Fold the runs of bit instructions that give a cell a value known before
+ * running, such as the '_', '^' and '+' that build a character, into a
+ * single literal store, and the output of such a cell into the output of its
+ * character. Within a piece the instructions run one after the other, so the
+ * value of a cell is known from a '%' on, or from the start of the program,
+ * where every cell is empty, until an instruction that the folding can't
+ * follow; the value is then stored just before anything that could see it,
+ * and not at all if nothing can, as at the end of the program. */
+void
+fold_literals()
+{
+	struct TLiteral literals[MAX_LITERALS];
+	struct TLiteral *literal;
+	struct TInstruction instruction;
+	int n_literals = 0;
+	/* Whether the cells not in "literals" are known to be empty. */
+	bool empty = true;
+	long long int next_pos;
+	long long int piece_start = 0;
+	long long int write_pos = 0;
+	char previous;
+
+	for (long long int pos = 0; pos <= program_length; pos = next_pos) {
+		previous = pos > 0 ? program[pos - 1] : '\0';
+		if (pos == program_length || previous == ':' ||
+		    previous == '!' || previous == ';' || previous == '@') {
+			/* The end of a piece. */
+			if (pos < program_length) {
+				write_pos = write_literals(
+				    literals, n_literals, write_pos);
+			}
+			if (write_pos > piece_start) {
+				decoded_program[write_pos - 1].length =
+				    pos - (write_pos - 1);
+			} else if (write_pos < pos) {
+				/* Everything has been folded away. */
+				decoded_program[write_pos].opcode = OP_NOP;
+				decoded_program[write_pos].length =
+				    pos - write_pos;
+				decoded_program[write_pos].move = 0;
+			}
+			if (pos == program_length) {
+				break;
+			}
+			piece_start = write_pos = pos;
+			n_literals = 0;
+			empty = false;
+		}
+
+		instruction = decoded_program[pos];
+		next_pos = pos + instruction.length;
+		instruction.length = 1;
+
+		switch (instruction.opcode) {
+		case OP_NEXT_BIT:
+		case OP_PREVIOUS_BIT:
+		case OP_FIRST_BIT:
+		case OP_SET_BIT_TO_ZERO:
+		case OP_SET_BIT_TO_ONE:
+		case OP_SET_BIT_TO_NULL:
+		case OP_SET_ALL_BITS_TO_NULL:
+		case OP_OUTPUT:
+		case OP_INPUT:
+		case OP_ENQUEUE:
+		case OP_DEQUEUE: {
+			literal = NULL;
+			for (int i = 0; i < n_literals; i++) {
+				if (literals[i].offset == instruction.offset) {
+					literal = &literals[i];
+				}
+			}
+			if (literal == NULL) {
+				if (n_literals == MAX_LITERALS) {
+					/* Start over. */
+					write_pos = write_literals(
+					    literals, n_literals, write_pos);
+					n_literals = 0;
+					empty = false;
+				}
+				literal = &literals[n_literals++];
+				literal->offset = instruction.offset;
+				literal->known = empty;
+				literal->pending = false;
+				literal->value = 0;
+				literal->length = 0;
+				literal->selected_bit = 0;
+			}
+
+			if (instruction.opcode == OP_INPUT ||
+			    instruction.opcode == OP_DEQUEUE) {
+				/* The value is replaced, or the function
+				 * terminated. */
+				literal->known = false;
+				literal->pending = false;
+				break;
+			}
+			if (instruction.opcode == OP_ENQUEUE) {
+				write_pos =
+				    write_literals(literal, 1, write_pos);
+				break;
+			}
+			if (instruction.opcode == OP_SET_ALL_BITS_TO_NULL) {
+				literal->known = true;
+			}
+			if (literal->known == false) {
+				break;
+			}
+			if (fold_instruction(literal, &instruction) == false) {
+				write_pos =
+				    write_literals(literal, 1, write_pos);
+				literal->known = false;
+				break;
+			}
+			if (instruction.opcode == OP_OUTPUT) {
+				instruction.opcode = OP_OUTPUT_CHARACTER;
+				instruction.operand =
+				    literal->length > 0 ? literal->value & 0xFF
+							: 0;
+				break;
+			}
+			literal->pending = true;
+			continue;
+		}
+		case OP_NOP: {
+			continue;
+		}
+		case OP_NEXT_LABEL:
+		case OP_PREVIOUS_LABEL:
+		case OP_FIRST_LABEL:
+		case OP_SELECT_LABEL: {
+			/* They don't see the cells, and if they fail the
+			 * function is terminated. */
+			break;
+		}
+		case OP_RETURN: {
+			/* The cells go away with the function. */
+			n_literals = 0;
+			empty = false;
+			break;
+		}
+		default: {
+			write_pos =
+			    write_literals(literals, n_literals, write_pos);
+			if (instruction.move != 0 ||
+			    (instruction.opcode != OP_IF_EQUAL_TO_1 &&
+			     instruction.opcode != OP_IF_EQUAL_TO_NULL)) {
+				/* The cursor moves, or the piece is left. */
+				n_literals = 0;
+				empty = false;
+			}
+		}
+		}
+
+		decoded_program[write_pos++] = instruction;
+	}
+}
+
+/* Change the known value of "literal" as "instruction" would; returns false
+ * if the value would get too long to be kept track of. */
+bool
+fold_instruction(
+    struct TLiteral *literal, const struct TInstruction *instruction)
+{
+	long long int i = literal->selected_bit;
+
+	switch (instruction->opcode) {
+	case OP_NEXT_BIT:
+		if (i + instruction->reach > MAX_LITERAL_LENGTH) {
+			return false;
+		}
+		if (i + instruction->reach > literal->length) {
+			/* The null bits passed over become 0. */
+			literal->length = i + instruction->reach;
+		}
+		literal->selected_bit += instruction->operand;
+		break;
+	case OP_PREVIOUS_BIT:
+		literal->selected_bit =
+		    i > instruction->operand ? i - instruction->operand : 0;
+		break;
+	case OP_FIRST_BIT:
+		literal->selected_bit = 0;
+		break;
+	case OP_SET_BIT_TO_ZERO:
+	case OP_SET_BIT_TO_ONE:
+		if (i == literal->length) {
+			if (i == MAX_LITERAL_LENGTH) {
+				return false;
+			}
+			literal->length++;
+		}
+		if (instruction->opcode == OP_SET_BIT_TO_ONE) {
+			literal->value |= (uint64_t)1 << i;
+		} else {
+			literal->value &= ~((uint64_t)1 << i);
+		}
+		break;
+	case OP_SET_BIT_TO_NULL:
+		if (i < literal->length) {
+			literal->length = i;
+			literal->value &= ((uint64_t)1 << i) - 1;
+		}
+		break;
+	case OP_SET_ALL_BITS_TO_NULL:
+		literal->value = 0;
+		literal->length = 0;
+		literal->selected_bit = 0;
+		break;
+	}
+	return true;
+}
+
+/* Store the values of "literals" that are still to be stored, from
+ * "write_pos" on; returns where the instructions after them go. */
+long long int
+write_literals(
+    struct TLiteral *literals, int n_literals, long long int write_pos)
+{
+	struct TInstruction *instruction;
+
+	for (int i = 0; i < n_literals; i++) {
+		if (literals[i].pending == false) {
+			continue;
+		}
+		instruction = &decoded_program[write_pos++];
+		instruction->opcode = OP_STORE_LITERAL;
+		instruction->length = 1;
+		instruction->operand = literals[i].selected_bit;
+		instruction->reach = literals[i].length;
+		instruction->offset = literals[i].offset;
+		instruction->move = 0;
+		instruction->value = literals[i].value;
+		literals[i].pending = false;
+	}
+	return write_pos;
+}
+
+/* Look for the loops that only move forward through the bits of the selected
+ * cell until a test succeeds, and make their '+' go straight to where it does:
+ * ':"!+\';' goes to the first null bit, ':?!+\';' to the first 1, and
+ * ':?+\';' to the first 0 or null bit. Every turn the test opens an if-else
+ * statement that the jump closes, so skipping turns changes nothing else; a
+ * scan for a 1 stops at the null bits, and leaves the loop to go on forever
+ * as written if there's none. */
+void
+find_bit_scans()
+{
+	struct TInstruction *test;
+	struct TInstruction *move;
+	struct TInstruction *jump;
+	long long int pos;
+	bool move_in_else_block;
+
+	for (long long int i = 0; i < n_labels; i++) {
+		pos = labels[i] + 1;
+		if (pos + 4 > program_length ||
+		    (program[pos] != '?' && program[pos] != '"')) {
+			continue;
+		}
+		move_in_else_block = program[pos + 1] == '!';
+		if (move_in_else_block) {
+			if (pos + 5 > program_length ||
+			    strncmp(program + pos + 1, "!+';", 4) != 0) {
+				continue;
+			}
+		} else if (
+		    program[pos] == '"' ||
+		    strncmp(program + pos + 1, "+';", 3) != 0) {
+			/* Null bits stay null: it never ends. */
+			continue;
+		}
+
+		test = &decoded_program[pos];
+		move = &decoded_program[move_in_else_block ? pos + 2 : pos + 1];
+		jump = move + 1;
+		if (test->offset != 0 || test->move != 0 ||
+		    move->opcode != OP_NEXT_BIT || move->operand != 1 ||
+		    move->offset != 0 || move->length != 1 ||
+		    jump->opcode != OP_DIRECT_JUMP || jump->operand != pos ||
+		    jump->move != 0) {
+			continue;
+		}
+		move->opcode = OP_SEEK_BIT;
+		if (move_in_else_block == false) {
+			move->operand = SEEK_ZERO;
+		} else if (program[pos] == '?') {
+			move->operand = SEEK_ONE;
+		} else {
+			move->operand = SEEK_NULL;
+		}
+	}
+}
+
+/* Look for the functions of the library at every label, and make the direct
+ * calls to them run natively. */
+void
+find_intrinsics()
+{
+	long long int length;
+
+	label_intrinsics = calloc(n_labels > 0 ? n_labels : 1, sizeof(int));
+	for (long long int i = 0; i < n_labels; i++) {
+		for (int intrinsic = INTRINSIC_NONE + 1;
+		     intrinsic < N_INTRINSICS; intrinsic++) {
+			length = strlen(INTRINSIC_BODIES[intrinsic]);
+			if (labels[i] + length <= program_length &&
+			    memcmp(
+				program + labels[i],
+				INTRINSIC_BODIES[intrinsic], length) == 0) {
+				label_intrinsics[i] = intrinsic;
+			}
+		}
+	}
+
+	/* The functions that call the others only do it where the library
+	 * puts them: "sub" calls the label two after its own, and
+	 * "show_binary" selects "add", "sub" and its own labels by their
+	 * number. */
+	for (long long int i = 0; i < n_labels; i++) {
+		if (label_intrinsics[i] == INTRINSIC_SUB &&
+		    (i + 2 >= n_labels ||
+		     label_intrinsics[i + 2] != INTRINSIC_NORMALIZE)) {
+			label_intrinsics[i] = INTRINSIC_NONE;
+		}
+		/* Numbered as in "bin/libraries/basic functions.bx". */
+		if (label_intrinsics[i] == INTRINSIC_SHOW_BINARY &&
+		    (i != 7 || label_intrinsics[0] != INTRINSIC_ADD ||
+		     label_intrinsics[2] != INTRINSIC_SUB)) {
+			label_intrinsics[i] = INTRINSIC_NONE;
+		}
+	}
+
+	for (long long int pos = 0; pos < program_length;
+	     pos += decoded_program[pos].length) {
+		if (decoded_program[pos].opcode == OP_DIRECT_CALL &&
+		    label_intrinsics[decoded_program[pos].reach] !=
+			INTRINSIC_NONE) {
+			decoded_program[pos].opcode = OP_INTRINSIC_CALL;
+		}
+	}
+}
+
+void
+execute_source_program()
+{
+	/* Start the main function of the source program. */
+	enter_function(0);
+
+	while (true) {
+		if (program_counter < program_length) {
+			current_instruction = program[program_counter++];
+			dbg_print_instruction();
+			if (profile_path != NULL) {
+				profile_instruction(program_counter - 1);
+			}
+			count_instruction(current_instruction);
+
+			process_current_instruction();
+		} else {
+			/* Reaching the end of the program terminates the
+			 * function. */
+			last_instruction_was_a_return = true;
+		}
+
+		if (last_instruction_was_a_function_call && bx_error == OK) {
+			if (n_labels == 0) {
+				bx_error = ERR_JUMP_BUT_NO_LABEL;
+			} else if (bx_call_depth == bx_max_call_depth) {
+				bx_error = ERR_CALL_STACK_OVERFLOW;
+				fatal_error = true;
+			}
+		}
+
+		if (bx_error != OK) {
+			last_instruction_was_a_function_call = false;
+			last_instruction_was_a_return = false;
+			bx_process_errors();
+
+			/* Terminate this function, or all of them. */
+			do {
+				if (leave_function() == false) {
+					return;
+				}
+				if (profile_path != NULL) {
+					profile_return();
+				}
+			} while (fatal_error);
+		} else if (last_instruction_was_a_function_call) {
+			last_instruction_was_a_function_call = false;
+
+			/* Call another function. */
+			save_caller();
+			enter_function(labels[curr_label]);
+			if (profile_path != NULL) {
+				profile_call(curr_label);
+			}
+			continue;
+		} else if (last_instruction_was_a_return) {
+			last_instruction_was_a_return = false;
+
+			/* Terminate this function. */
+			if (leave_function() == false) {
+				return;
+			}
+			if (profile_path != NULL) {
+				profile_return();
+			}
+		}
+
+		dbg_print_stack_info();
+	}
+}
+
+/* Same as "execute_source_program", but running "decoded_program" with the
+ * state of the running function kept in local variables; they're saved to the
+ * globals only around calls and returns, which use the same call stack. */
+void
+execute_decoded_program()
+{
+#ifdef USE_COMPUTED_GOTO
+#define HANDLER(opcode) handler_##opcode
+#define ADDRESS_OF(opcode) [opcode] = __extension__ &&handler_##opcode
+#define DISPATCH() __extension__({ goto *instruction->handler; })
+	static const void *const handlers[N_OPCODES] = {
+	    ADDRESS_OF(OP_NEXT_CELL),
+	    ADDRESS_OF(OP_PREVIOUS_CELL),
+	    ADDRESS_OF(OP_FIRST_CELL),
+	    ADDRESS_OF(OP_NEXT_BIT),
+	    ADDRESS_OF(OP_PREVIOUS_BIT),
+	    ADDRESS_OF(OP_FIRST_BIT),
+	    ADDRESS_OF(OP_SET_BIT_TO_ZERO),
+	    ADDRESS_OF(OP_SET_BIT_TO_ONE),
+	    ADDRESS_OF(OP_SET_BIT_TO_NULL),
+	    ADDRESS_OF(OP_SET_ALL_BITS_TO_NULL),
+	    ADDRESS_OF(OP_OUTPUT),
+	    ADDRESS_OF(OP_INPUT),
+	    ADDRESS_OF(OP_ENQUEUE),
+	    ADDRESS_OF(OP_DEQUEUE),
+	    ADDRESS_OF(OP_IF_EQUAL_TO_1),
+	    ADDRESS_OF(OP_IF_EQUAL_TO_NULL),
+	    ADDRESS_OF(OP_ELSE),
+	    ADDRESS_OF(OP_END_IF),
+	    ADDRESS_OF(OP_LABEL),
+	    ADDRESS_OF(OP_NEXT_LABEL),
+	    ADDRESS_OF(OP_PREVIOUS_LABEL),
+	    ADDRESS_OF(OP_FIRST_LABEL),
+	    ADDRESS_OF(OP_JUMP),
+	    ADDRESS_OF(OP_CALL),
+	    ADDRESS_OF(OP_RETURN),
+	    ADDRESS_OF(OP_NOP),
+	    ADDRESS_OF(OP_SELECT_LABEL),
+	    ADDRESS_OF(OP_DIRECT_JUMP),
+	    ADDRESS_OF(OP_DIRECT_CALL),
+	    ADDRESS_OF(OP_STORE_LITERAL),
+	    ADDRESS_OF(OP_OUTPUT_CHARACTER),
+	    ADDRESS_OF(OP_INTRINSIC_CALL),
+	    ADDRESS_OF(OP_SEEK_BIT),
+	};
+#else
+#define HANDLER(opcode) case opcode
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()                                                                 \
+	do {                                                                   \
+		instruction += instruction->length;                            \
+		DISPATCH();                                                    \
+	} while (0)
+#define LOAD_FUNCTION_STATE()                                                  \
+	do {                                                                   \
+		instruction = decoded_program + program_counter;               \
+		cells = bx_tape;                                               \
+		cell = selected_cell;                                          \
+		base = bx_if_else_base;                                        \
+		depth = bx_if_else_depth;                                      \
+	} while (0)
+#define SELECT_TARGET_CELL()                                                   \
+	do {                                                                   \
+		n = cell - cells.cells;                                        \
+		if (n + instruction->offset < cells.n_cells) {                 \
+			target_cell = cell + instruction->offset;              \
+		} else {                                                       \
+			target_cell =                                          \
+			    next_cell(&cells, cell, instruction->offset);      \
+			cell = cells.cells + n;                                \
+		}                                                              \
+	} while (0)
+#define MOVE_CURSOR()                                                          \
+	do {                                                                   \
+		if (instruction->move != 0) {                                  \
+			cell = next_cell(&cells, cell, instruction->move);     \
+		}                                                              \
+	} while (0)
+#define STORE_FUNCTION_STATE()                                                 \
+	do {                                                                   \
+		program_counter = instruction - decoded_program;               \
+		bx_tape = cells;                                               \
+		selected_cell = cell;                                          \
+		bx_if_else_base = base;                                        \
+		bx_if_else_depth = depth;                                      \
+	} while (0)
+
+	struct TInstruction *instruction;
+	struct TTape cells;
+	struct TCell *cell;
+	struct TCell *target_cell;
+	long long int base;
+	long long int depth;
+	long long int top;
+	long long int target = 0;
+	long long int n;
+	long long int label = curr_label;
+
+#ifdef USE_COMPUTED_GOTO
+	for (long long int pos = 0; pos <= program_length; pos++) {
+		decoded_program[pos].handler =
+		    handlers[decoded_program[pos].opcode];
+	}
+#endif
+
+	/* Start the main function of the source program. */
+	enter_function(0);
+	LOAD_FUNCTION_STATE();
+
+#ifdef USE_COMPUTED_GOTO
+	DISPATCH();
+	{
+#else
+dispatch:
+	switch (instruction->opcode) {
+#endif
+	HANDLER(OP_NEXT_CELL) :
+		cell = next_cell(&cells, cell, instruction->operand);
+		NEXT();
+	HANDLER(OP_PREVIOUS_CELL) :
+		if (cell - cells.cells > instruction->operand) {
+			cell -= instruction->operand;
+		} else {
+			cell = cells.cells;
+		}
+		NEXT();
+	HANDLER(OP_FIRST_CELL) :
+		cell = cells.cells;
+		NEXT();
+	HANDLER(OP_NEXT_BIT) :
+		SELECT_TARGET_CELL();
+		n = target_cell->selected_bit + instruction->reach;
+		if (n > target_cell->bits.length) {
+			/* The null bits passed over become 0. */
+			bx_extend_bits(&target_cell->bits, n);
+		}
+		target_cell->selected_bit += instruction->operand;
+		NEXT();
+	HANDLER(OP_PREVIOUS_BIT) :
+		SELECT_TARGET_CELL();
+		if (target_cell->selected_bit > instruction->operand) {
+			target_cell->selected_bit -= instruction->operand;
+		} else {
+			target_cell->selected_bit = 0;
+		}
+		NEXT();
+	HANDLER(OP_FIRST_BIT) :
+		SELECT_TARGET_CELL();
+		target_cell->selected_bit = 0;
+		NEXT();
+	HANDLER(OP_SET_BIT_TO_ZERO) :
+		SELECT_TARGET_CELL();
+		set_bit_to_zero(target_cell);
+		NEXT();
+	HANDLER(OP_SET_BIT_TO_ONE) :
+		SELECT_TARGET_CELL();
+		set_bit_to_one(target_cell);
+		NEXT();
+	HANDLER(OP_SET_BIT_TO_NULL) :
+		SELECT_TARGET_CELL();
+		bx_truncate_bits(&target_cell->bits, target_cell->selected_bit);
+		NEXT();
+	HANDLER(OP_SET_ALL_BITS_TO_NULL) :
+		SELECT_TARGET_CELL();
+		target_cell->selected_bit = 0;
+		bx_truncate_bits(&target_cell->bits, 0);
+		NEXT();
+	HANDLER(OP_OUTPUT) :
+		SELECT_TARGET_CELL();
+		output(target_cell);
+		NEXT();
+	HANDLER(OP_STORE_LITERAL) :
+		SELECT_TARGET_CELL();
+		bx_store_literal(
+		    target_cell, instruction->value, instruction->reach,
+		    instruction->operand);
+		NEXT();
+	HANDLER(OP_OUTPUT_CHARACTER) :
+		output_character((char)instruction->operand);
+		NEXT();
+	HANDLER(OP_INPUT) :
+		SELECT_TARGET_CELL();
+		target_cell->selected_bit = 0;
+		bx_truncate_bits(&target_cell->bits, 0);
+		input(target_cell);
+		if (bx_error != OK) {
+			goto handle_error;
+		}
+		NEXT();
+	HANDLER(OP_ENQUEUE) :
+		SELECT_TARGET_CELL();
+		bx_enqueue(target_cell);
+		NEXT();
+	HANDLER(OP_DEQUEUE) :
+		SELECT_TARGET_CELL();
+		bx_dequeue(target_cell);
+		if (bx_error != OK) {
+			goto handle_error;
+		}
+		NEXT();
+	HANDLER(OP_IF_EQUAL_TO_1) :
+		MOVE_CURSOR();
+		SELECT_TARGET_CELL();
+		bx_if_else_stack[depth / 64] &= ~((uint64_t)1 << (depth % 64));
+		depth++;
+		if (get_bit(&target_cell->bits, target_cell->selected_bit) ==
+		    false) {
+			goto skip_if_else_block;
+		}
+		NEXT();
+	HANDLER(OP_IF_EQUAL_TO_NULL) :
+		MOVE_CURSOR();
+		SELECT_TARGET_CELL();
+		bx_if_else_stack[depth / 64] &= ~((uint64_t)1 << (depth % 64));
+		depth++;
+		if (target_cell->selected_bit < target_cell->bits.length) {
+			goto skip_if_else_block;
+		}
+		NEXT();
+	HANDLER(OP_ELSE) :
+		MOVE_CURSOR();
+		top = depth - 1;
+		if (depth == base ||
+		    (bx_if_else_stack[top / 64] >> (top % 64) & 1) !=
+			CONDITION_IF) {
+			bx_error = ERR_MISPLACED_ELSE;
+			goto handle_error;
+		}
+		/* The if block has just been executed: skip the else one. */
+		goto skip_if_else_block;
+	HANDLER(OP_END_IF) :
+		MOVE_CURSOR();
+		if (depth == base) {
+			bx_error = ERR_END_IF;
+			goto handle_error;
+		}
+		depth--;
+		NEXT();
+	HANDLER(OP_LABEL) :
+		MOVE_CURSOR();
+		NEXT();
+	HANDLER(OP_NEXT_LABEL) :
+		if (label + instruction->operand >= n_labels) {
+			/* It stops on the last label. */
+			if (n_labels > 0) {
+				label = n_labels - 1;
+			}
+			bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+			goto handle_error;
+		}
+		label += instruction->operand;
+		NEXT();
+	HANDLER(OP_PREVIOUS_LABEL) :
+		if (label < instruction->operand) {
+			/* It stops on the first label. */
+			label = 0;
+			bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+			goto handle_error;
+		}
+		label -= instruction->operand;
+		NEXT();
+	HANDLER(OP_FIRST_LABEL) :
+		if (n_labels == 0) {
+			bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+			goto handle_error;
+		}
+		label = 0;
+		NEXT();
+	HANDLER(OP_SELECT_LABEL) :
+		label = instruction->operand;
+		NEXT();
+	HANDLER(OP_JUMP) :
+		MOVE_CURSOR();
+		if (n_labels == 0) {
+			bx_error = ERR_JUMP_BUT_NO_LABEL;
+			goto handle_error;
+		}
+		/* Straight after the ':'. */
+		instruction = decoded_program + labels[label] + 1;
+		depth = base;
+		DISPATCH();
+	HANDLER(OP_DIRECT_JUMP) :
+		MOVE_CURSOR();
+		instruction = decoded_program + instruction->operand;
+		depth = base;
+		DISPATCH();
+	HANDLER(OP_CALL) :
+		if (n_labels == 0) {
+			bx_error = ERR_JUMP_BUT_NO_LABEL;
+			goto handle_error;
+		}
+		target = labels[label] + 1;
+		goto call_function;
+	HANDLER(OP_DIRECT_CALL) :
+		target = instruction->operand;
+		goto call_function;
+	HANDLER(OP_INTRINSIC_CALL) :
+		n = call_intrinsic(instruction->reach);
+		if (n >= 0) {
+			label = n;
+			MOVE_CURSOR();
+			NEXT();
+		}
+		target = instruction->operand;
+		goto call_function;
+	HANDLER(OP_RETURN) :
+		bx_tape = cells;
+		if (leave_function() == false) {
+			goto end;
+		}
+		LOAD_FUNCTION_STATE();
+		DISPATCH();
+	HANDLER(OP_SEEK_BIT) :
+		SELECT_TARGET_CELL();
+		bx_seek_bit(target_cell, instruction->operand);
+		NEXT();
+	HANDLER(OP_NOP) :
+		NEXT();
+	}
+
+call_function:
+	MOVE_CURSOR();
+	if (bx_call_depth == bx_max_call_depth) {
+		bx_error = ERR_CALL_STACK_OVERFLOW;
+		fatal_error = true;
+		goto handle_error;
+	}
+	instruction += instruction->length;
+	STORE_FUNCTION_STATE();
+	save_caller();
+	enter_function(target);
+	LOAD_FUNCTION_STATE();
+	DISPATCH();
+
+skip_if_else_block:
+	target = instruction->operand;
+	if (target == IF_ELSE_JUMP_TO_ERROR) {
+		bx_error = ERR_MISPLACED_ELSE;
+		goto handle_error;
+	}
+	if (target == program_length) {
+		instruction = decoded_program + program_length;
+		DISPATCH();
+	}
+	if (program[target] == '!') {
+		/* Enter the else block. */
+		top = depth - 1;
+		bx_if_else_stack[top / 64] |= (uint64_t)CONDITION_ELSE
+					   << (top % 64);
+	} else {
+		depth--;
+	}
+	instruction = decoded_program + target + 1;
+	DISPATCH();
+
+handle_error:
+	bx_process_errors();
+	bx_tape = cells;
+
+	/* Terminate this function, or all of them. */
+	do {
+		if (leave_function() == false) {
+			goto end;
+		}
+	} while (fatal_error);
+	LOAD_FUNCTION_STATE();
+	DISPATCH();
+
+end:
+	curr_label = label;
+
+#undef HANDLER
+#undef ADDRESS_OF
+#undef DISPATCH
+#undef NEXT
+#undef SELECT_TARGET_CELL
+#undef MOVE_CURSOR
+#undef LOAD_FUNCTION_STATE
+#undef STORE_FUNCTION_STATE
+}
+
+/* Push the running function on the call stack. */
+void
+save_caller()
+{
+	bx_save_caller(program_counter, selected_cell);
+	count_call();
+}
+
+void
+enter_function(long long int from_pos)
+{
+	bx_enter_function();
+	selected_cell = bx_tape.cells;
+
+	/* Start from a given position. */
+	program_counter = from_pos;
+}
+
+bool
+leave_function()
+{
+	struct TFrame *caller;
+
+	count_cells(bx_tape.n_cells);
+	caller = bx_leave_function();
+	selected_cell = NULL;
+	if (caller == NULL) {
+		/* The main function has terminated. */
+		return false;
+	}
+
+	/* Restore the caller. */
+	program_counter = caller->return_pos;
+	selected_cell = bx_tape.cells + caller->index_of_the_selected_cell;
+	return true;
+}
+
+/* Same as "execute_decoded_program", but running the decoded program compiled
+ * to machine code, when it can be. */
+void
+execute_compiled_program()
+{
+#ifdef USE_JIT
+	void (*run)(void);
+
+	if (compile_program()) {
+		/* Start the main function of the source program. */
+		enter_function(0);
+		memcpy(&run, &jit_memory, sizeof(run));
+		run();
+
+		munmap(jit_memory, jit_memory_size);
+		jit_memory = NULL;
+		free(jit_entry_points);
+		jit_entry_points = NULL;
+		return;
+	}
+#endif
+	execute_decoded_program();
+}
+
+#ifdef USE_JIT
+/* Compile "decoded_program" to x86-64 machine code. The code of every
+ * instruction runs into the one of the next instruction, while skips, jumps,
+ * calls and returns jump to the code of their target; calls and returns go
+ * through the same call stack as the other engines, so that the machine stack
+ * never grows. While the code runs, rbx holds the selected cell, r12 the end
+ * of the cells visited so far, r13 the cell an instruction acts on when it's
+ * another one, and r14 the address of "bx_tape", from which all the other
+ * globals are reached; the rest of the state is in the globals, as for the
+ * reference loop. Growing the cells, calls, returns and errors are left to
+ * the "jit_" functions, and input, output and the global queue to the same
+ * functions as the other engines. Returns false when the program can't be
+ * compiled. */
+bool
+compile_program()
+{
+	long long int pos;
+	long long int exit_offset;
+	long long int fail_offset;
+
+	jit_failed = false;
+	jit_offsets = malloc((program_length + 1) * sizeof(long long int));
+	for (pos = 0; pos <= program_length; pos++) {
+		jit_offsets[pos] = -1;
+	}
+
+	/* Save the registers of the caller, keeping the stack aligned for the
+	 * calls, and start from "program_counter". */
+	jit_emit_byte(0x53); /* push rbx */
+	jit_emit_byte(0x41); /* push r12 */
+	jit_emit_byte(0x54);
+	jit_emit_byte(0x41); /* push r13 */
+	jit_emit_byte(0x55);
+	jit_emit_byte(0x41); /* push r14 */
+	jit_emit_byte(0x56);
+	jit_emit_register_operand(true, 0x81, 5, RSP); /* sub rsp, 8 */
+	jit_emit_u32(8);
+	jit_emit_move_immediate(R14, (uintptr_t)&bx_tape);
+	jit_emit_reload();
+	jit_emit_load(RAX, R14, jit_global(&program_counter));
+	jit_emit_load(RDX, R14, jit_global(&jit_entry_points));
+	jit_emit_memory_operand(false, 0xFF, 4, RDX, RAX, 0); /* jmp */
+
+	/* The end of the program. */
+	exit_offset = jit_code_length;
+	jit_emit_register_operand(true, 0x81, 0, RSP); /* add rsp, 8 */
+	jit_emit_u32(8);
+	jit_emit_byte(0x41); /* pop r14 */
+	jit_emit_byte(0x5E);
+	jit_emit_byte(0x41); /* pop r13 */
+	jit_emit_byte(0x5D);
+	jit_emit_byte(0x41); /* pop r12 */
+	jit_emit_byte(0x5C);
+	jit_emit_byte(0x5B); /* pop rbx */
+	jit_emit_byte(0xC3); /* ret */
+
+	/* Terminate the function with the error in edi, then go on from where
+	 * a "jit_" function says. */
+	fail_offset = jit_code_length;
+	jit_emit_store(R14, jit_global(&selected_cell), RBX);
+	jit_emit_call((uintptr_t)jit_fail);
+	jit_resume_offset = jit_code_length;
+	jit_emit_register_operand(true, 0x85, RAX, RAX); /* test rax, rax */
+	jit_patch_jump(jit_emit_jump(EQUAL), exit_offset);
+	jit_emit_reload();
+	jit_emit_register_operand(false, 0xFF, 4, RAX); /* jmp rax */
+
+	for (int code = OK; code < N_ERRORS; code++) {
+		jit_error_offsets[code] = jit_code_length;
+		jit_emit_move_immediate(RDI, code);
+		jit_patch_jump(jit_emit_jump(JUMP_ALWAYS), fail_offset);
+	}
+
+	/* The instructions, in the order in which the engine runs them. */
+	for (pos = 0; pos <= program_length;
+	     pos += decoded_program[pos].length) {
+		jit_offsets[pos] = jit_code_length;
+		compile_instruction(pos);
+	}
+	for (long long int i = 0; i < n_jit_jumps; i++) {
+		if (jit_offsets[jit_jumps[i].pos] < 0) {
+			jit_failed = true;
+		} else {
+			jit_patch_jump(
+			    jit_jumps[i].at, jit_offsets[jit_jumps[i].pos]);
+		}
+	}
+
+	/* Copy the code where it can be run. */
+	if (jit_failed == false) {
+		jit_memory_size = jit_code_length;
+		jit_memory = mmap(
+		    NULL, jit_memory_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (jit_memory == MAP_FAILED) {
+			jit_memory = NULL;
+			jit_failed = true;
+		} else {
+			memcpy(jit_memory, jit_code, jit_memory_size);
+			if (mprotect(
+				jit_memory, jit_memory_size,
+				PROT_READ | PROT_EXEC) != 0) {
+				munmap(jit_memory, jit_memory_size);
+				jit_memory = NULL;
+				jit_failed = true;
+			}
+		}
+	}
+	if (jit_failed == false) {
+		jit_entry_points =
+		    malloc((program_length + 1) * sizeof(unsigned char *));
+		for (pos = 0; pos <= program_length; pos++) {
+			jit_entry_points[pos] = NULL;
+			if (jit_offsets[pos] >= 0) {
+				jit_entry_points[pos] =
+				    jit_memory + jit_offsets[pos];
+			}
+		}
+	}
+
+	free(jit_code);
+	jit_code = NULL;
+	jit_code_length = 0;
+	jit_code_capacity = 0;
+	free(jit_offsets);
+	jit_offsets = NULL;
+	free(jit_jumps);
+	jit_jumps = NULL;
+	n_jit_jumps = 0;
+	jit_jumps_capacity = 0;
+	return jit_failed == false;
+}
+
+/* The machine code of the instruction at "pos"; it does the same as its
+ * handler in "execute_decoded_program". */
+void
+compile_instruction(long long int pos)
+{
+	const long long int CELL_SIZE = sizeof(struct TCell);
+	const long long int BITS = offsetof(struct TCell, bits);
+	const long long int BUFFER = offsetof(struct TCell, bits.buffer);
+	const long long int LENGTH = offsetof(struct TCell, bits.length);
+	const long long int SELECTED_BIT = offsetof(struct TCell, selected_bit);
+	const long long int N_REFERENCES =
+	    offsetof(struct TWords, n_references);
+	const long long int WORDS = offsetof(struct TWords, words);
+	struct TInstruction *instruction = &decoded_program[pos];
+	long long int next_pos = pos + instruction->length;
+	long long int at;
+	long long int at_shared;
+	long long int at_end;
+	int cell;
+
+	switch (instruction->opcode) {
+	case OP_NEXT_CELL:
+		jit_emit_move_cursor(instruction->operand);
+		break;
+	case OP_PREVIOUS_CELL:
+		/* The cursor stops on the first cell. */
+		jit_emit_load(RCX, R14, jit_global(&bx_tape.cells));
+		jit_emit_register_operand(true, 0x8B, RAX, RBX); /* mov */
+		jit_emit_register_operand(true, 0x2B, RAX, RCX); /* sub */
+		jit_emit_register_operand(true, 0x81, 5, RBX);	 /* sub */
+		jit_emit_u32(jit_immediate(instruction->operand * CELL_SIZE));
+		jit_emit_register_operand(true, 0x81, 7, RAX); /* cmp */
+		jit_emit_u32(jit_immediate(instruction->operand * CELL_SIZE));
+		jit_emit_register_operand(true, 0x0F4E, RBX, RCX); /* cmovle */
+		break;
+	case OP_FIRST_CELL:
+		jit_emit_load(RBX, R14, jit_global(&bx_tape.cells));
+		break;
+	case OP_NEXT_BIT:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_load(RAX, cell, SELECTED_BIT);
+		jit_emit_register_operand(true, 0x81, 0, RAX); /* add */
+		jit_emit_u32(jit_immediate(instruction->reach));
+		jit_emit_memory_operand(true, 0x3B, RAX, cell, -1, LENGTH);
+		at = jit_emit_jump(LESS_OR_EQUAL);
+		/* The null bits passed over become 0. */
+		jit_emit_memory_operand(true, 0x8D, RDI, cell, -1, BITS);
+		jit_emit_register_operand(true, 0x8B, RSI, RAX); /* mov */
+		jit_emit_call((uintptr_t)bx_extend_bits);
+		jit_patch_jump(at, jit_code_length);
+		jit_emit_memory_operand(true, 0x81, 0, cell, -1, SELECTED_BIT);
+		jit_emit_u32(jit_immediate(instruction->operand)); /* add */
+		break;
+	case OP_PREVIOUS_BIT:
+		/* The cursor stops on the first bit. */
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_load(RAX, cell, SELECTED_BIT);
+		jit_emit_register_operand(false, 0x31, RCX, RCX); /* xor */
+		jit_emit_register_operand(true, 0x81, 5, RAX);	  /* sub */
+		jit_emit_u32(jit_immediate(instruction->operand));
+		jit_emit_register_operand(true, 0x0F4E, RAX, RCX); /* cmovle */
+		jit_emit_store(cell, SELECTED_BIT, RAX);
+		break;
+	case OP_FIRST_BIT:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_memory_operand(true, 0xC7, 0, cell, -1, SELECTED_BIT);
+		jit_emit_u32(0); /* mov */
+		break;
+	case OP_SET_BIT_TO_ZERO:
+	case OP_SET_BIT_TO_ONE:
+		/* Change the bit in place when it's there and its words aren't
+		 * shared, or leave it to the function. */
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_load(RAX, cell, SELECTED_BIT);
+		jit_emit_memory_operand(true, 0x3B, RAX, cell, -1, LENGTH);
+		at = jit_emit_jump(GREATER_OR_EQUAL);
+		jit_emit_load(RDX, cell, BUFFER);
+		jit_emit_memory_operand(true, 0x81, 7, RDX, -1, N_REFERENCES);
+		jit_emit_u32(1); /* cmp */
+		at_shared = jit_emit_jump(NOT_EQUAL);
+		jit_emit_bit_operation(
+		    instruction->opcode == OP_SET_BIT_TO_ZERO
+			? BIT_TEST_AND_RESET
+			: BIT_TEST_AND_SET,
+		    WORDS);
+		at_end = jit_emit_jump(JUMP_ALWAYS);
+		jit_patch_jump(at, jit_code_length);
+		jit_patch_jump(at_shared, jit_code_length);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_call(
+		    instruction->opcode == OP_SET_BIT_TO_ZERO
+			? (uintptr_t)set_bit_to_zero
+			: (uintptr_t)set_bit_to_one);
+		jit_patch_jump(at_end, jit_code_length);
+		break;
+	case OP_SET_BIT_TO_NULL:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_memory_operand(true, 0x8D, RDI, cell, -1, BITS);
+		jit_emit_load(RSI, cell, SELECTED_BIT);
+		jit_emit_call((uintptr_t)bx_truncate_bits);
+		break;
+	case OP_SET_ALL_BITS_TO_NULL:
+	case OP_INPUT:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_memory_operand(true, 0xC7, 0, cell, -1, SELECTED_BIT);
+		jit_emit_u32(0); /* mov */
+		jit_emit_memory_operand(true, 0x8D, RDI, cell, -1, BITS);
+		jit_emit_register_operand(false, 0x31, RSI, RSI); /* xor */
+		jit_emit_call((uintptr_t)bx_truncate_bits);
+		if (instruction->opcode == OP_INPUT) {
+			jit_emit_register_operand(true, 0x8B, RDI, cell);
+			jit_emit_call((uintptr_t)input);
+			jit_emit_error_check();
+		}
+		break;
+	case OP_OUTPUT:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_call((uintptr_t)output);
+		break;
+	case OP_STORE_LITERAL:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_move_immediate(RSI, instruction->value);
+		jit_emit_move_immediate(RDX, instruction->reach);
+		jit_emit_move_immediate(RCX, instruction->operand);
+		jit_emit_call((uintptr_t)bx_store_literal);
+		break;
+	case OP_OUTPUT_CHARACTER:
+		jit_emit_move_immediate(RDI, (char)instruction->operand);
+		jit_emit_call((uintptr_t)output_character);
+		break;
+	case OP_ENQUEUE:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_call((uintptr_t)bx_enqueue);
+		break;
+	case OP_DEQUEUE:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_call((uintptr_t)bx_dequeue);
+		jit_emit_error_check();
+		break;
+	case OP_IF_EQUAL_TO_1:
+	case OP_IF_EQUAL_TO_NULL:
+		jit_emit_move_cursor(instruction->move);
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_load(RDX, R14, jit_global(&bx_if_else_stack));
+		jit_emit_load(RAX, R14, jit_global(&bx_if_else_depth));
+		jit_emit_bit_operation(BIT_TEST_AND_RESET, 0);
+		jit_emit_memory_operand(
+		    true, 0xFF, 0, R14, -1,
+		    jit_global(&bx_if_else_depth)); /* inc */
+		jit_emit_load(RAX, cell, SELECTED_BIT);
+		jit_emit_memory_operand(true, 0x3B, RAX, cell, -1, LENGTH);
+		if (instruction->opcode == OP_IF_EQUAL_TO_NULL) {
+			at = jit_emit_jump(GREATER_OR_EQUAL);
+			jit_emit_skip_if_else_block(instruction->operand);
+			jit_patch_jump(at, jit_code_length);
+			break;
+		}
+		at = jit_emit_jump(GREATER_OR_EQUAL);
+		jit_emit_load(RDX, cell, BUFFER);
+		jit_emit_bit_operation(BIT_TEST, WORDS);
+		at_end = jit_emit_jump(BELOW);
+		jit_patch_jump(at, jit_code_length);
+		jit_emit_skip_if_else_block(instruction->operand);
+		jit_patch_jump(at_end, jit_code_length);
+		break;
+	case OP_ELSE:
+		jit_emit_move_cursor(instruction->move);
+		jit_emit_load(RAX, R14, jit_global(&bx_if_else_depth));
+		jit_emit_memory_operand(
+		    true, 0x3B, RAX, R14, -1, jit_global(&bx_if_else_base));
+		jit_patch_jump(
+		    jit_emit_jump(EQUAL),
+		    jit_error_offsets[ERR_MISPLACED_ELSE]);
+		jit_emit_register_operand(true, 0xFF, 1, RAX); /* dec */
+		jit_emit_load(RDX, R14, jit_global(&bx_if_else_stack));
+		jit_emit_bit_operation(BIT_TEST, 0);
+		jit_patch_jump(
+		    jit_emit_jump(BELOW),
+		    jit_error_offsets[ERR_MISPLACED_ELSE]);
+		/* The if block has just been executed: skip the else one. */
+		jit_emit_skip_if_else_block(instruction->operand);
+		break;
+	case OP_END_IF:
+		jit_emit_move_cursor(instruction->move);
+		jit_emit_load(RAX, R14, jit_global(&bx_if_else_depth));
+		jit_emit_memory_operand(
+		    true, 0x3B, RAX, R14, -1, jit_global(&bx_if_else_base));
+		jit_patch_jump(
+		    jit_emit_jump(EQUAL), jit_error_offsets[ERR_END_IF]);
+		jit_emit_memory_operand(
+		    true, 0xFF, 1, R14, -1,
+		    jit_global(&bx_if_else_depth)); /* dec */
+		break;
+	case OP_LABEL:
+		jit_emit_move_cursor(instruction->move);
+		break;
+	case OP_NEXT_LABEL:
+		jit_emit_load(RAX, R14, jit_global(&curr_label));
+		jit_emit_register_operand(true, 0x81, 0, RAX); /* add */
+		jit_emit_u32(jit_immediate(instruction->operand));
+		jit_emit_memory_operand(
+		    true, 0x3B, RAX, R14, -1, jit_global(&n_labels));
+		at = jit_emit_jump(LESS);
+		/* It stops on the last label. */
+		jit_emit_load(RCX, R14, jit_global(&n_labels));
+		jit_emit_register_operand(true, 0x85, RCX, RCX); /* test */
+		jit_patch_jump(
+		    jit_emit_jump(LESS_OR_EQUAL),
+		    jit_error_offsets[ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS]);
+		jit_emit_register_operand(true, 0xFF, 1, RCX); /* dec */
+		jit_emit_store(R14, jit_global(&curr_label), RCX);
+		jit_patch_jump(
+		    jit_emit_jump(JUMP_ALWAYS),
+		    jit_error_offsets[ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS]);
+		jit_patch_jump(at, jit_code_length);
+		jit_emit_store(R14, jit_global(&curr_label), RAX);
+		break;
+	case OP_PREVIOUS_LABEL:
+		jit_emit_load(RAX, R14, jit_global(&curr_label));
+		jit_emit_register_operand(true, 0x81, 5, RAX); /* sub */
+		jit_emit_u32(jit_immediate(instruction->operand));
+		at = jit_emit_jump(GREATER_OR_EQUAL);
+		/* It stops on the first label. */
+		jit_emit_memory_operand(
+		    true, 0xC7, 0, R14, -1, jit_global(&curr_label));
+		jit_emit_u32(0); /* mov */
+		jit_patch_jump(
+		    jit_emit_jump(JUMP_ALWAYS),
+		    jit_error_offsets[ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS]);
+		jit_patch_jump(at, jit_code_length);
+		jit_emit_store(R14, jit_global(&curr_label), RAX);
+		break;
+	case OP_FIRST_LABEL:
+		jit_emit_memory_operand(
+		    true, 0x81, 7, R14, -1, jit_global(&n_labels));
+		jit_emit_u32(0); /* cmp */
+		jit_patch_jump(
+		    jit_emit_jump(EQUAL),
+		    jit_error_offsets[ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS]);
+		/* Fall through. */
+	case OP_SELECT_LABEL:
+		jit_emit_memory_operand(
+		    true, 0xC7, 0, R14, -1, jit_global(&curr_label));
+		jit_emit_u32(jit_immediate(
+		    instruction->opcode == OP_SELECT_LABEL
+			? instruction->operand
+			: 0)); /* mov */
+		break;
+	case OP_JUMP:
+	case OP_DIRECT_JUMP:
+		jit_emit_move_cursor(instruction->move);
+		if (instruction->opcode == OP_JUMP) {
+			jit_emit_label_check();
+		}
+		jit_emit_load(RAX, R14, jit_global(&bx_if_else_base));
+		jit_emit_store(R14, jit_global(&bx_if_else_depth), RAX);
+		if (instruction->opcode == OP_DIRECT_JUMP) {
+			jit_emit_jump_to_pos(JUMP_ALWAYS, instruction->operand);
+			break;
+		}
+		/* Straight after the ':'. */
+		jit_emit_load(RAX, R14, jit_global(&labels));
+		jit_emit_load(RCX, R14, jit_global(&curr_label));
+		jit_emit_memory_operand(true, 0x8B, RAX, RAX, RCX, 0); /* mov */
+		jit_emit_load(RDX, R14, jit_global(&jit_entry_points));
+		jit_emit_memory_operand(
+		    false, 0xFF, 4, RDX, RAX,
+		    sizeof(unsigned char *)); /* jmp */
+		break;
+	case OP_CALL:
+	case OP_DIRECT_CALL:
+	case OP_INTRINSIC_CALL:
+		/* Unlike the engine, the cursor is moved before looking for the
+		 * label: it makes no difference, as a missing label terminates
+		 * the function. */
+		jit_emit_move_cursor(instruction->move);
+		if (instruction->opcode == OP_INTRINSIC_CALL) {
+			/* Unless the function has to be run as written. */
+			jit_emit_move_immediate(RDI, instruction->reach);
+			jit_emit_call((uintptr_t)call_intrinsic);
+			jit_emit_register_operand(true, 0x85, RAX, RAX);
+			at = jit_emit_jump(LESS);
+			jit_emit_store(R14, jit_global(&curr_label), RAX);
+			jit_emit_jump_to_pos(JUMP_ALWAYS, next_pos);
+			jit_patch_jump(at, jit_code_length);
+		}
+		if (instruction->opcode == OP_CALL) {
+			jit_emit_label_check();
+			jit_emit_load(RAX, R14, jit_global(&labels));
+			jit_emit_load(RCX, R14, jit_global(&curr_label));
+			jit_emit_memory_operand(true, 0x8B, RSI, RAX, RCX, 0);
+			jit_emit_register_operand(true, 0x81, 0, RSI); /* add */
+			jit_emit_u32(1);
+		} else {
+			jit_emit_move_immediate(RSI, instruction->operand);
+		}
+		jit_emit_store(R14, jit_global(&selected_cell), RBX);
+		jit_emit_move_immediate(RDI, next_pos);
+		jit_emit_call((uintptr_t)jit_call);
+		jit_patch_jump(jit_emit_jump(JUMP_ALWAYS), jit_resume_offset);
+		break;
+	case OP_RETURN:
+		jit_emit_store(R14, jit_global(&selected_cell), RBX);
+		jit_emit_call((uintptr_t)jit_return);
+		jit_patch_jump(jit_emit_jump(JUMP_ALWAYS), jit_resume_offset);
+		break;
+	case OP_SEEK_BIT:
+		cell = jit_emit_select_target_cell(instruction);
+		jit_emit_register_operand(true, 0x8B, RDI, cell); /* mov */
+		jit_emit_move_immediate(RSI, instruction->operand);
+		jit_emit_call((uintptr_t)bx_seek_bit);
+		break;
+	case OP_NOP:
+		break;
+	}
+}
+
+/* Move the selected cell (rbx) forward by "distance" cells. */
+void
+jit_emit_move_cursor(long long int distance)
+{
+	long long int at;
+
+	if (distance == 0) {
+		return;
+	}
+	jit_emit_register_operand(true, 0x81, 0, RBX); /* add */
+	jit_emit_u32(
+	    jit_immediate(distance * (long long int)sizeof(struct TCell)));
+	jit_emit_register_operand(true, 0x39, R12, RBX); /* cmp */
+	at = jit_emit_jump(BELOW);
+	/* Past the cells visited so far. */
+	jit_emit_register_operand(true, 0x81, 5, RBX); /* sub */
+	jit_emit_u32(
+	    jit_immediate(distance * (long long int)sizeof(struct TCell)));
+	jit_emit_store(R14, jit_global(&selected_cell), RBX);
+	jit_emit_move_immediate(RDI, distance);
+	jit_emit_call((uintptr_t)jit_move_cursor);
+	jit_emit_reload();
+	jit_patch_jump(at, jit_code_length);
+}
+
+/* Put the cell "instruction" acts on in r13, unless it's the selected one;
+ * returns the register that holds it. */
+int
+jit_emit_select_target_cell(struct TInstruction *instruction)
+{
+	long long int at;
+
+	if (instruction->offset == 0) {
+		return RBX;
+	}
+	/* lea */
+	jit_emit_memory_operand(
+	    true, 0x8D, R13, RBX, -1,
+	    instruction->offset * (long long int)sizeof(struct TCell));
+	jit_emit_register_operand(true, 0x39, R12, R13); /* cmp */
+	at = jit_emit_jump(BELOW);
+	jit_emit_store(R14, jit_global(&selected_cell), RBX);
+	jit_emit_move_immediate(RDI, instruction->offset);
+	jit_emit_call((uintptr_t)jit_target_cell);
+	jit_emit_register_operand(true, 0x8B, R13, RAX); /* mov */
+	jit_emit_reload();
+	jit_patch_jump(at, jit_code_length);
+	return R13;
+}
+
+/* Go on after the if or else block of the statement whose '?', '"' or '!'
+ * skips to "target", as "skip_if_else_block" does; a misplaced '!' has no
+ * target, but it never gets to skip. */
+void
+jit_emit_skip_if_else_block(long long int target)
+{
+	if (target < 0) {
+		jit_patch_jump(
+		    jit_emit_jump(JUMP_ALWAYS),
+		    jit_error_offsets[ERR_MISPLACED_ELSE]);
+		return;
+	}
+	if (target == program_length) {
+		jit_emit_jump_to_pos(JUMP_ALWAYS, program_length);
+		return;
+	}
+	if (program[target] == '!') {
+		/* Enter the else block. */
+		jit_emit_load(RAX, R14, jit_global(&bx_if_else_depth));
+		jit_emit_register_operand(true, 0xFF, 1, RAX); /* dec */
+		jit_emit_load(RDX, R14, jit_global(&bx_if_else_stack));
+		jit_emit_bit_operation(BIT_TEST_AND_SET, 0);
+	} else {
+		jit_emit_memory_operand(
+		    true, 0xFF, 1, R14, -1,
+		    jit_global(&bx_if_else_depth)); /* dec */
+	}
+	jit_emit_jump_to_pos(JUMP_ALWAYS, target + 1);
+}
+
+/* Terminate the function if there are no labels to jump to. */
+void
+jit_emit_label_check()
+{
+	jit_emit_memory_operand(true, 0x81, 7, R14, -1, jit_global(&n_labels));
+	jit_emit_u32(0); /* cmp */
+	jit_patch_jump(
+	    jit_emit_jump(EQUAL), jit_error_offsets[ERR_JUMP_BUT_NO_LABEL]);
+}
+
+/* Terminate the function if a function has set "error". */
+void
+jit_emit_error_check()
+{
+	jit_emit_byte(0x66); /* 16 bits, as "error" */
+	jit_emit_memory_operand(false, 0x83, 7, R14, -1, jit_global(&bx_error));
+	jit_emit_byte(0); /* cmp */
+	jit_patch_jump(jit_emit_jump(NOT_EQUAL), jit_error_offsets[OK]);
+}
+
+/* Load rbx and r12 from the globals, after a "jit_" function changed them. */
+void
+jit_emit_reload()
+{
+	jit_emit_load(RBX, R14, jit_global(&selected_cell));
+	jit_emit_load(R12, R14, jit_global(&bx_tape.n_cells));
+	jit_emit_register_operand(true, 0x69, R12, R12); /* imul */
+	jit_emit_u32(sizeof(struct TCell));
+	jit_emit_memory_operand(
+	    true, 0x03, R12, R14, -1, jit_global(&bx_tape.cells)); /* add */
+}
+
+/* Apply "operation" to the bit of index rax of the words that start
+ * "displacement" bytes after rdx; uses rcx and rdx. */
+void
+jit_emit_bit_operation(int operation, long long int displacement)
+{
+	jit_emit_register_operand(true, 0x8B, RCX, RAX); /* mov */
+	jit_emit_register_operand(true, 0xC1, 5, RAX);	 /* shr */
+	jit_emit_byte(6);
+	jit_emit_memory_operand(true, 0x8D, RDX, RDX, RAX, displacement);
+	jit_emit_load(RAX, RDX, 0);
+	jit_emit_register_operand(true, operation, RCX, RAX);
+	if (operation != BIT_TEST) {
+		jit_emit_store(RDX, 0, RAX);
+	}
+}
+
+/* Where "variable" is from r14. */
+long long int
+jit_global(const void *variable)
+{
+	return jit_immediate((intptr_t)variable - (intptr_t)&bx_tape);
+}
+
+/* "value" as the 32 bits immediate of an instruction; the program can't be
+ * compiled if it doesn't fit. */
+int32_t
+jit_immediate(long long int value)
+{
+	if (value < INT32_MIN || value > INT32_MAX) {
+		jit_failed = true;
+		return 0;
+	}
+	return (int32_t)value;
+}
+
+void
+jit_emit_byte(int byte)
+{
+	if (jit_code_length == jit_code_capacity) {
+		jit_code_capacity =
+		    jit_code_capacity == 0 ? 4096 : jit_code_capacity * 2;
+		jit_code = realloc(jit_code, jit_code_capacity);
+	}
+	jit_code[jit_code_length++] = (unsigned char)byte;
+}
+
+void
+jit_emit_u32(uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		jit_emit_byte(value >> (8 * i) & 0xFF);
+	}
+}
+
+void
+jit_emit_u64(uint64_t value)
+{
+	for (int i = 0; i < 8; i++) {
+		jit_emit_byte(value >> (8 * i) & 0xFF);
+	}
+}
+
+/* The REX prefix and the one or two bytes of "opcode". */
+void
+jit_emit_opcode(bool wide, int opcode, int reg, int index, int base)
+{
+	int rex = 0x40 | wide << 3 | (reg >> 3 & 1) << 2 |
+		  (index >> 3 & 1) << 1 | (base >> 3 & 1);
+
+	if (rex != 0x40) {
+		jit_emit_byte(rex);
+	}
+	if (opcode > 0xFF) {
+		jit_emit_byte(opcode >> 8);
+	}
+	jit_emit_byte(opcode & 0xFF);
+}
+
+/* An instruction on the registers "reg" and "rm"; "reg" may be the extension
+ * of the opcode instead. */
+void
+jit_emit_register_operand(bool wide, int opcode, int reg, int rm)
+{
+	jit_emit_opcode(wide, opcode, reg, 0, rm);
+	jit_emit_byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* An instruction on the register "reg", or an extension of the opcode, and
+ * on the memory at "base" + "index" * 8 + "displacement", "index" being -1
+ * for none. */
+void
+jit_emit_memory_operand(
+    bool wide, int opcode, int reg, int base, int index,
+    long long int displacement)
+{
+	bool short_displacement = displacement >= -128 && displacement <= 127;
+	int mod = short_displacement ? 0x40 : 0x80;
+
+	jit_emit_opcode(wide, opcode, reg, index < 0 ? 0 : index, base);
+	if (index >= 0) {
+		jit_emit_byte(mod | (reg & 7) << 3 | RSP);
+		jit_emit_byte(3 << 6 | (index & 7) << 3 | (base & 7));
+	} else if ((base & 7) == RSP) {
+		jit_emit_byte(mod | (reg & 7) << 3 | RSP);
+		jit_emit_byte(RSP << 3 | RSP);
+	} else {
+		jit_emit_byte(mod | (reg & 7) << 3 | (base & 7));
+	}
+	if (short_displacement) {
+		jit_emit_byte(displacement & 0xFF);
+	} else {
+		jit_emit_u32(jit_immediate(displacement));
+	}
+}
+
+void
+jit_emit_load(int reg, int base, long long int displacement)
+{
+	jit_emit_memory_operand(true, 0x8B, reg, base, -1, displacement);
+}
+
+void
+jit_emit_store(int base, long long int displacement, int reg)
+{
+	jit_emit_memory_operand(true, 0x89, reg, base, -1, displacement);
+}
+
+void
+jit_emit_move_immediate(int reg, uint64_t value)
+{
+	if (value <= UINT32_MAX) {
+		jit_emit_opcode(false, 0xB8 + (reg & 7), 0, 0, reg);
+		jit_emit_u32(value);
+	} else {
+		jit_emit_opcode(true, 0xB8 + (reg & 7), 0, 0, reg);
+		jit_emit_u64(value);
+	}
+}
 
+/* Call a C function, whose arguments are in rdi and rsi. */
 void
-instruction_go_to_first_bit()
+jit_emit_call(uintptr_t function)
 {
-	selected_cell->selected_bit = &selected_cell->ignored_starting_bit;
+	jit_emit_move_immediate(RAX, function);
+	jit_emit_register_operand(false, 0xFF, 2, RAX); /* call rax */
 }
 
-void
-instruction_set_bit_to_zero()
+/* A jump to be patched with "jit_patch_jump"; returns where its target
+ * goes. */
+long long int
+jit_emit_jump(int condition)
 {
-	if (selected_cell->selected_bit->next == NULL) {
-		struct TBit *new_bit = malloc(sizeof(struct TBit));
-		selected_cell->selected_bit->next = new_bit;
-		new_bit->value = false;
-		new_bit->next = NULL;
-		new_bit->prev = selected_cell->selected_bit;
+	if (condition == JUMP_ALWAYS) {
+		jit_emit_byte(0xE9);
 	} else {
-		selected_cell->selected_bit->next->value = false;
+		jit_emit_byte(0x0F);
+		jit_emit_byte(0x80 + condition);
 	}
+	jit_emit_u32(0);
+	return jit_code_length - 4;
 }
 
 void
-instruction_set_bit_to_one()
+jit_patch_jump(long long int at, long long int target)
 {
-	if (selected_cell->selected_bit->next == NULL) {
-		selected_cell->selected_bit->next = malloc(sizeof(struct TBit));
-		selected_cell->selected_bit->next->value = true;
-		selected_cell->selected_bit->next->next = NULL;
-		selected_cell->selected_bit->next->prev =
-		    selected_cell->selected_bit;
-	} else {
-		selected_cell->selected_bit->next->value = true;
+	uint32_t distance = (uint32_t)(target - (at + 4));
+
+	for (int i = 0; i < 4; i++) {
+		jit_code[at + i] = distance >> (8 * i) & 0xFF;
 	}
 }
 
+/* A jump to the code of the instruction at "pos", which may not have been
+ * compiled yet. */
 void
-instruction_set_bit_to_null()
+jit_emit_jump_to_pos(int condition, long long int pos)
+{
+	if (n_jit_jumps == jit_jumps_capacity) {
+		jit_jumps_capacity =
+		    jit_jumps_capacity == 0 ? 64 : jit_jumps_capacity * 2;
+		jit_jumps =
+		    realloc(jit_jumps, jit_jumps_capacity * sizeof(*jit_jumps));
+	}
+	jit_jumps[n_jit_jumps].at = jit_emit_jump(condition);
+	jit_jumps[n_jit_jumps].pos = pos;
+	n_jit_jumps++;
+}
+
+/* Called by the machine code, with the whole state in the globals; they
+ * return the code to go on from, NULL meaning the end of the program. */
+const unsigned char *
+jit_call(long long int return_pos, long long int target)
+{
+	if (bx_call_depth == bx_max_call_depth) {
+		fatal_error = true;
+		return jit_fail(ERR_CALL_STACK_OVERFLOW);
+	}
+	program_counter = return_pos;
+	save_caller();
+	enter_function(target);
+	return jit_entry_points[target];
+}
+
+const unsigned char *
+jit_return()
+{
+	if (leave_function() == false) {
+		return NULL;
+	}
+	return jit_entry_points[program_counter];
+}
+
+/* Terminate the function, or all of them, because of "code", or of the error
+ * that has already been set if it's OK. */
+const unsigned char *
+jit_fail(int code)
 {
-	selected_cell->selected_bit->next = NULL;
+	if (code != OK) {
+		bx_error = code;
+	}
+	bx_process_errors();
+	do {
+		if (leave_function() == false) {
+			return NULL;
+		}
+	} while (fatal_error);
+	return jit_entry_points[program_counter];
 }
 
 void
-instruction_set_all_bits_to_null_and_go_to_first_bit()
+jit_move_cursor(long long int distance)
 {
-	selected_cell->selected_bit = &selected_cell->ignored_starting_bit;
-	selected_cell->selected_bit->next = NULL;
+	selected_cell = next_cell(&bx_tape, selected_cell, distance);
 }
 
+struct TCell *
+jit_target_cell(long long int offset)
+{
+	long long int n = selected_cell - bx_tape.cells;
+	struct TCell *target_cell = next_cell(&bx_tape, selected_cell, offset);
+
+	selected_cell = bx_tape.cells + n;
+	return target_cell;
+}
+#endif
+
+/* Print "decoded_program" translated to C, to be compiled with "runtime.c"
+ * and "core.c". Every instruction becomes a few statements, labelled with its
+ * position when something goes to it: skips, jumps and calls become gotos, a
+ * call saving where to return to on the call stack of the runtime, and a
+ * return goes back there through a switch over all the places calls return
+ * to. */
 void
-instruction_print_cell_value_as_ASCII_character()
+emit_c_program()
 {
-	output(selected_cell);
+	bool *is_target = calloc(program_length + 1, sizeof(bool));
+	bool enters_labels = false;
+	bool fails = false;
+	struct TInstruction *instruction;
+	long long int next_pos;
+	long long int target;
+	char cell[64];
+
+	/* Where the program can go to from elsewhere. */
+	for (long long int pos = 0; pos <= program_length; pos = next_pos) {
+		instruction = &decoded_program[pos];
+		next_pos = pos + instruction->length;
+		switch (instruction->opcode) {
+		case OP_IF_EQUAL_TO_1:
+		case OP_IF_EQUAL_TO_NULL:
+		case OP_ELSE:
+			target = instruction->operand;
+			if (target >= 0 && target != program_length) {
+				is_target[target + 1] = true;
+			}
+			break;
+		case OP_JUMP:
+		case OP_CALL:
+			enters_labels = true;
+			break;
+		case OP_DIRECT_JUMP:
+		case OP_DIRECT_CALL:
+			is_target[instruction->operand] = true;
+			break;
+		}
+		if (instruction->opcode == OP_CALL ||
+		    instruction->opcode == OP_DIRECT_CALL) {
+			is_target[next_pos] = true;
+		}
+	}
+	if (enters_labels) {
+		for (long long int i = 0; i < n_labels; i++) {
+			/* Straight after the ':'. */
+			is_target[labels[i] + 1] = true;
+		}
+	}
+
+	printf(
+	    "/*\n * %s\n *\n * Translated to C by the BoolX interpreter; "
+	    "compile it with \"runtime.c\"\n * and \"core.c\".\n */\n\n",
+	    source_program_path);
+	printf("#include \"runtime.h\"\n\n");
+	printf("int\nmain(int argc, char *argv[])\n{\n");
+	printf(
+	    "\tstruct TCell *c = bx_start(argc, argv, %lld, %lld);\n\n",
+	    n_labels, bx_if_else_max_depth);
+
+	for (long long int pos = 0; pos <= program_length; pos = next_pos) {
+		instruction = &decoded_program[pos];
+		next_pos = pos + instruction->length;
+		if (is_target[pos]) {
+			printf("p%lld:\n", pos);
+		}
+
+		/* The cell the instruction acts on. */
+		if (instruction->offset == 0) {
+			snprintf(cell, sizeof(cell), "c");
+		} else {
+			snprintf(
+			    cell, sizeof(cell), "bx_target_cell(&c, %lld)",
+			    instruction->offset);
+		}
+		if (instruction->move != 0) {
+			printf(
+			    "\tc = bx_next_cell(c, %lld);\n",
+			    instruction->move);
+		}
+
+		switch (instruction->opcode) {
+		case OP_NEXT_CELL:
+			printf(
+			    "\tc = bx_next_cell(c, %lld);\n",
+			    instruction->operand);
+			break;
+		case OP_PREVIOUS_CELL:
+			printf(
+			    "\tc = bx_previous_cell(c, %lld);\n",
+			    instruction->operand);
+			break;
+		case OP_FIRST_CELL:
+			printf("\tc = bx_tape.cells;\n");
+			break;
+		case OP_NEXT_BIT:
+			printf(
+			    "\tbx_next_bit(%s, %lld, %lld);\n", cell,
+			    instruction->operand, instruction->reach);
+			break;
+		case OP_PREVIOUS_BIT:
+			printf(
+			    "\tbx_previous_bit(%s, %lld);\n", cell,
+			    instruction->operand);
+			break;
+		case OP_FIRST_BIT:
+			printf("\t%s->selected_bit = 0;\n", cell);
+			break;
+		case OP_SET_BIT_TO_ZERO:
+			printf("\tbx_set_bit_to_zero(%s);\n", cell);
+			break;
+		case OP_SET_BIT_TO_ONE:
+			printf("\tbx_set_bit_to_one(%s);\n", cell);
+			break;
+		case OP_SET_BIT_TO_NULL:
+			printf("\tbx_set_bit_to_null(%s);\n", cell);
+			break;
+		case OP_SET_ALL_BITS_TO_NULL:
+			printf("\tbx_set_all_bits_to_null(%s);\n", cell);
+			break;
+		case OP_OUTPUT:
+			printf("\tbx_output(%s);\n", cell);
+			break;
+		case OP_STORE_LITERAL:
+			printf(
+			    "\tbx_store_literal(%s, UINT64_C(0x%llx), %lld, "
+			    "%lld);\n",
+			    cell, (unsigned long long int)instruction->value,
+			    instruction->reach, instruction->operand);
+			break;
+		case OP_OUTPUT_CHARACTER:
+			printf(
+			    "\tbx_output_character(%d);\n",
+			    (char)instruction->operand);
+			break;
+		case OP_SEEK_BIT:
+			printf(
+			    "\tbx_seek_bit(%s, %s);\n", cell,
+			    instruction->operand == SEEK_NULL  ? "SEEK_NULL"
+			    : instruction->operand == SEEK_ONE ? "SEEK_ONE"
+							       : "SEEK_ZERO");
+			break;
+		case OP_INPUT:
+			printf(
+			    "\tif (bx_input(%s) == false) {\n"
+			    "\t\tgoto fail;\n\t}\n",
+			    cell);
+			fails = true;
+			break;
+		case OP_ENQUEUE:
+			printf("\tbx_enqueue(%s);\n", cell);
+			break;
+		case OP_DEQUEUE:
+			printf(
+			    "\tif (bx_dequeue(%s) == false) {\n"
+			    "\t\tgoto fail;\n\t}\n",
+			    cell);
+			fails = true;
+			break;
+		case OP_IF_EQUAL_TO_1:
+		case OP_IF_EQUAL_TO_NULL:
+			printf("\tbx_push_if_else_statement();\n");
+			printf(
+			    "\tif (%s(%s) == false) {\n",
+			    instruction->opcode == OP_IF_EQUAL_TO_1
+				? "bx_is_one"
+				: "bx_is_null",
+			    cell);
+			fails |= emit_c_skip_if_else_block(
+			    instruction->operand, "\t\t");
+			printf("\t}\n");
+			break;
+		case OP_ELSE:
+			printf(
+			    "\tif (bx_is_in_if_block() == false) {\n"
+			    "\t\tbx_error = ERR_MISPLACED_ELSE;\n"
+			    "\t\tgoto fail;\n\t}\n");
+			fails = true;
+			/* The if block has just been executed: skip the else
+			 * one. */
+			emit_c_skip_if_else_block(instruction->operand, "\t");
+			break;
+		case OP_END_IF:
+			printf(
+			    "\tif (bx_if_else_depth == bx_if_else_base) {\n"
+			    "\t\tbx_error = ERR_END_IF;\n"
+			    "\t\tgoto fail;\n\t}\n"
+			    "\tbx_if_else_depth--;\n");
+			fails = true;
+			break;
+		case OP_NEXT_LABEL:
+		case OP_PREVIOUS_LABEL:
+			printf(
+			    "\tif (%s(%lld) == false) {\n"
+			    "\t\tgoto fail;\n\t}\n",
+			    instruction->opcode == OP_NEXT_LABEL
+				? "bx_next_label"
+				: "bx_previous_label",
+			    instruction->operand);
+			fails = true;
+			break;
+		case OP_FIRST_LABEL:
+			printf(
+			    "\tif (bx_first_label() == false) {\n"
+			    "\t\tgoto fail;\n\t}\n");
+			fails = true;
+			break;
+		case OP_SELECT_LABEL:
+			printf("\tbx_label = %lld;\n", instruction->operand);
+			break;
+		case OP_JUMP:
+		case OP_CALL:
+			printf(
+			    "\tif (bx_has_labels() == false) {\n"
+			    "\t\tgoto fail;\n\t}\n");
+			fails = true;
+			/* Fall through. */
+		case OP_DIRECT_JUMP:
+		case OP_DIRECT_CALL:
+			if (instruction->opcode == OP_JUMP ||
+			    instruction->opcode == OP_DIRECT_JUMP) {
+				printf(
+				    "\tbx_if_else_depth = bx_if_else_base;\n");
+			} else {
+				printf(
+				    "\tc = bx_call(c, %lld);\n"
+				    "\tif (c == NULL) {\n"
+				    "\t\tgoto fail;\n\t}\n",
+				    next_pos);
+				fails = true;
+			}
+			if (instruction->opcode == OP_JUMP ||
+			    instruction->opcode == OP_CALL) {
+				printf("\tgoto enter_label;\n");
+			} else {
+				printf("\tgoto p%lld;\n", instruction->operand);
+			}
+			break;
+		case OP_RETURN:
+			printf("\tgoto leave;\n");
+			break;
+		}
+	}
+
+	if (enters_labels) {
+		printf("enter_label:\n\tswitch (bx_label) {\n");
+		for (long long int i = 0; i < n_labels; i++) {
+			printf(
+			    "\tcase %lld:\n\t\tgoto p%lld;\n", i,
+			    labels[i] + 1);
+		}
+		printf("\t}\n");
+	}
+	if (fails) {
+		printf("fail:\n\tc = bx_fail();\n\tgoto resume;\n");
+	}
+	printf("leave:\n\tc = bx_return();\n");
+	if (fails) {
+		printf("resume:\n");
+	}
+	printf("\tif (c == NULL) {\n\t\treturn bx_finish();\n\t}\n");
+	printf("\tswitch (bx_return_pos) {\n");
+	for (long long int pos = 0; pos <= program_length; pos++) {
+		if (is_target[pos] && pos > 0 && program[pos - 1] == '@') {
+			printf("\tcase %lld:\n\t\tgoto p%lld;\n", pos, pos);
+		}
+	}
+	printf("\t}\n\treturn bx_finish();\n}\n");
+
+	free(is_target);
+}
+
+/* The statements that go on after the if or else block of the statement
+ * whose '?', '"' or '!' skips to "target", as "skip_if_else_block" does;
+ * returns whether they can fail. */
+bool
+emit_c_skip_if_else_block(long long int target, const char *indentation)
+{
+	if (target < 0) {
+		printf(
+		    "%sbx_error = ERR_MISPLACED_ELSE;\n%sgoto fail;\n",
+		    indentation, indentation);
+		return true;
+	}
+	if (target == program_length) {
+		printf("%sgoto leave;\n", indentation);
+		return false;
+	}
+	if (program[target] == '!') {
+		/* Enter the else block. */
+		printf("%sbx_enter_else_block();\n", indentation);
+	} else {
+		printf("%sbx_if_else_depth--;\n", indentation);
+	}
+	printf("%sgoto p%lld;\n", indentation, target + 1);
+	return false;
 }
 
 void
-instruction_get_ASCII_input_and_save_as_cell_value()
+process_current_instruction()
 {
-	selected_cell->selected_bit = &selected_cell->ignored_starting_bit;
-	selected_cell->ignored_starting_bit.next = NULL;
-	input(selected_cell);
+	switch (current_instruction) {
+	case '?': {
+		instruction_if_condition_equal_to_1();
+		break;
+	}
+	case '"': {
+		instruction_if_condition_equal_to_null();
+		break;
+	}
+	case '!': {
+		instruction_else_condition();
+		break;
+	}
+	case ';': {
+		instruction_end_of_if_else_statement();
+		break;
+	}
+	case '>': {
+		instruction_go_to_next_cell();
+		break;
+	}
+	case '<': {
+		instruction_go_to_previous_cell();
+		break;
+	}
+	case '+': {
+		instruction_go_to_next_bit();
+		break;
+	}
+	case '-': {
+		instruction_go_to_previous_bit();
+		break;
+	}
+	case '|': {
+		instruction_go_to_first_cell();
+		break;
+	}
+	case '=': {
+		instruction_go_to_first_bit();
+		break;
+	}
+	case '_': {
+		instruction_set_bit_to_zero();
+		break;
+	}
+	case '^': {
+		instruction_set_bit_to_one();
+		break;
+	}
+	case '*': {
+		instruction_set_bit_to_null();
+		break;
+	}
+	case '%': {
+		instruction_set_all_bits_to_null_and_go_to_first_bit();
+		break;
+	}
+	case ']': {
+		instruction_print_cell_value_as_ASCII_character();
+		break;
+	}
+	case '[': {
+		instruction_get_ASCII_input_and_save_as_cell_value();
+		break;
+	}
+	case '#': {
+		instruction_global_queue_enqueue();
+		break;
+	}
+	case '&': {
+		instruction_global_queue_dequeue();
+		break;
+	}
+	case '@': {
+		instruction_call_function();
+		break;
+	}
+	case '\'': {
+		instruction_jump_to_label();
+		break;
+	}
+	case '/': {
+		instruction_select_next_label();
+		break;
+	}
+	case '\\': {
+		instruction_select_previous_label();
+		break;
+	}
+	case '$': {
+		instruction_select_first_label();
+		break;
+	}
+	case '~': {
+		instruction_return();
+		break;
+	}
+	}
 }
 
 void
-instruction_global_queue_enqueue()
+skip_if_else_block()
 {
-	if (front_global_cell == NULL) {
-		front_global_cell = malloc(sizeof(struct TGlobalCell));
-		front_global_cell->ignored_starting_bit.next = NULL;
-		front_global_cell->ignored_starting_bit.prev = NULL;
-		front_global_cell->next = NULL;
-		back_global_cell = front_global_cell;
+	/* The instruction that started the skip has already been read. */
+	long long int target = if_else_jump_table[program_counter - 1];
+
+	if (target == IF_ELSE_JUMP_TO_ERROR) {
+		bx_error = ERR_MISPLACED_ELSE;
+		return;
+	}
+	if (profile_path != NULL) {
+		skips[program_counter - 1]++;
+	}
+	if (target == program_length) {
+		program_counter = program_length;
+		return;
+	}
+
+	if (program[target] == '!') {
+		bx_enter_else_block();
 	} else {
-		struct TGlobalCell *new_gl_cell =
-		    malloc(sizeof(struct TGlobalCell));
-		back_global_cell->next = new_gl_cell;
-		back_global_cell = new_gl_cell;
-		back_global_cell->ignored_starting_bit.next = NULL;
-		back_global_cell->ignored_starting_bit.prev = NULL;
-		back_global_cell->next = NULL;
+		bx_if_else_depth--;
 	}
+	program_counter = target + 1;
+}
 
-	struct TBit *curr_cell_curr_bit_tmp =
-	    &selected_cell->ignored_starting_bit;
-	struct TBit *global_curr_bit = &back_global_cell->ignored_starting_bit;
-	while (curr_cell_curr_bit_tmp->next != NULL) {
-		/* Create a new bit for the global cell. */
-		struct TBit *global_new_bit = malloc(sizeof(struct TBit));
-		global_curr_bit->next = global_new_bit;
-		global_new_bit->value = curr_cell_curr_bit_tmp->next->value;
-		global_new_bit->prev = global_curr_bit;
+void
+instruction_if_condition_equal_to_1()
+{
+	bx_push_if_else_statement();
 
-		/* Next */
-		curr_cell_curr_bit_tmp = curr_cell_curr_bit_tmp->next;
-		global_curr_bit = global_new_bit;
+	if (get_bit(&selected_cell->bits, selected_cell->selected_bit) ==
+	    false) {
+		skip_if_else_block();
 	}
-	global_curr_bit->next = NULL;
 }
 
 void
-instruction_global_queue_dequeue()
+instruction_if_condition_equal_to_null()
 {
-	if (front_global_cell == NULL) {
-		error = ERR_EMPTY_GLOBAL_STACK;
-		return;
-	}
+	bx_push_if_else_statement();
 
-	struct TBit *curr_cell_starting_bit;
-	struct TGlobalCell *global_cell_to_delete;
+	if (selected_cell->selected_bit < selected_cell->bits.length) {
+		skip_if_else_block();
+	}
+}
 
-	free_cell_content(selected_cell);
+void
+instruction_else_condition()
+{
+	if (bx_is_in_if_block() == false) {
+		bx_error = ERR_MISPLACED_ELSE;
+	} else {
+		/* The if block has just been executed: skip the else one. */
+		skip_if_else_block();
+	}
+}
 
-	/* free_global_cell_content() is slow, just change the TBit pointers. */
-	curr_cell_starting_bit = &selected_cell->ignored_starting_bit;
-	if (front_global_cell->ignored_starting_bit.next == NULL) {
-		/* The cell has null value, */
-		curr_cell_starting_bit->next = NULL;
+void
+instruction_end_of_if_else_statement()
+{
+	if (bx_if_else_depth == bx_if_else_base) {
+		bx_error = ERR_END_IF;
 	} else {
-		curr_cell_starting_bit->next =
-		    front_global_cell->ignored_starting_bit.next;
+		bx_if_else_depth--;
+	}
+}
+
+void
+instruction_go_to_next_cell()
+{
+	selected_cell = next_cell(&bx_tape, selected_cell, 1);
+}
 
-		/* Give it the new parent. */
-		curr_cell_starting_bit->next->prev = curr_cell_starting_bit;
+void
+instruction_go_to_previous_cell()
+{
+	if (selected_cell > bx_tape.cells) {
+		selected_cell--;
 	}
-	/* Delete the global cell. */
-	global_cell_to_delete = front_global_cell;
-	if (front_global_cell->next != NULL) {
-		front_global_cell = front_global_cell->next;
-	} else {
-		front_global_cell = NULL;
+}
+
+void
+instruction_go_to_next_bit()
+{
+	go_to_next_bit(selected_cell);
+}
+
+void
+instruction_go_to_previous_bit()
+{
+	if (selected_cell->selected_bit > 0) {
+		selected_cell->selected_bit--;
 	}
-	free(global_cell_to_delete);
+}
+
+void
+instruction_go_to_first_cell()
+{
+	selected_cell = bx_tape.cells;
+}
+
+void
+instruction_go_to_first_bit()
+{
+	selected_cell->selected_bit = 0;
+}
+
+void
+instruction_set_bit_to_zero()
+{
+	set_bit_to_zero(selected_cell);
+}
+
+void
+instruction_set_bit_to_one()
+{
+	set_bit_to_one(selected_cell);
+}
+
+void
+instruction_set_bit_to_null()
+{
+	bx_truncate_bits(&selected_cell->bits, selected_cell->selected_bit);
+}
+
+void
+instruction_set_all_bits_to_null_and_go_to_first_bit()
+{
+	selected_cell->selected_bit = 0;
+	bx_truncate_bits(&selected_cell->bits, 0);
+}
+
+void
+instruction_print_cell_value_as_ASCII_character()
+{
+	output(selected_cell);
+}
+
+void
+instruction_get_ASCII_input_and_save_as_cell_value()
+{
+	selected_cell->selected_bit = 0;
+	bx_truncate_bits(&selected_cell->bits, 0);
+	input(selected_cell);
+}
+
+void
+instruction_global_queue_enqueue()
+{
+	bx_enqueue(selected_cell);
+}
+
+void
+instruction_global_queue_dequeue()
+{
+	bx_dequeue(selected_cell);
 }
 
 void
 instruction_select_next_label()
 {
-	if (first_label == NULL) {
-		error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+	if (n_labels == 0) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
 		return;
 	}
-	if (curr_label->next == NULL) {
-		error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+	if (curr_label + 1 == n_labels) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
 		return;
 	}
-	curr_label = curr_label->next;
+	curr_label++;
 }
 
 void
 instruction_select_previous_label()
 {
-	if (first_label == NULL) {
-		error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+	if (n_labels == 0) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
 		return;
 	}
-	if (curr_label->prev == NULL) {
-		error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+	if (curr_label == 0) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
 		return;
 	}
-	curr_label = curr_label->prev;
+	curr_label--;
 }
 
 void
 instruction_select_first_label()
 {
-	if (first_label == NULL) {
-		error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+	if (n_labels == 0) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
 		return;
 	}
-	curr_label = first_label;
+	curr_label = 0;
 }
 
 void
-instruction_jump_to_label(FILE *source_program)
+instruction_jump_to_label()
 {
-	if (first_label == NULL) {
-		error = ERR_JUMP_BUT_NO_LABEL;
+	if (n_labels == 0) {
+		bx_error = ERR_JUMP_BUT_NO_LABEL;
 		return;
 	}
-	fseek(source_program, curr_label->file_pos, SEEK_SET);
+	program_counter = labels[curr_label];
+	count_jump();
 
 	clear_if_else_statements();
 }
@@ -842,21 +3600,13 @@ dbg_print_labels()
 {
 	if (debug) {
 		printf("List of labels:\n");
-		if (first_label == NULL) {
+		if (n_labels == 0) {
 			printf("\t(empty)\n");
 		} else {
-			struct TLabel *curr_label_test = first_label;
-			int i = 0;
-			while (curr_label_test != NULL) {
+			for (int i = 0; i < n_labels; i++) {
 				printf(
 				    "\tLabel #%d: position: %llu\n", i,
-				    curr_label_test->file_pos);
-				if (curr_label_test->next == NULL) {
-					curr_label_test = NULL;
-				} else {
-					curr_label_test = curr_label_test->next;
-					i++;
-				}
+				    labels[i]);
 			}
 		}
 		printf("\n");
@@ -870,48 +3620,12 @@ dbg_print_instruction()
 		return;
 	}
 
-	char additional_info[32] = "";
-	bool show_symbol = true;
-	bool is_comment = false;
-	bool is_empty_character = false;
-
 	debug_state.instr_has_immediate_effect_in_memory = true;
 
-	if (n_nested_comments > 0 || current_instruction == '{') {
-		my_strcpy(
-		    additional_info, "   (comment)", sizeof additional_info);
-		is_comment = true;
-		debug_state.instr_has_immediate_effect_in_memory = false;
-	} else if (skip_instruction_because_of_if_else_statement) {
-		my_strcpy(
-		    additional_info, "   (skipping execution)",
-		    sizeof additional_info);
-		debug_state.instr_has_immediate_effect_in_memory = false;
-	} else if (current_instruction == '\r') {
-		my_strcpy(
-		    additional_info, "(carriage return)",
-		    sizeof additional_info);
-		is_empty_character = true;
-		debug_state.instr_has_immediate_effect_in_memory = false;
-		show_symbol = false;
-	} else if (current_instruction == '\n') {
-		my_strcpy(
-		    additional_info, "(new line)", sizeof additional_info);
-		is_empty_character = true;
-		debug_state.instr_has_immediate_effect_in_memory = false;
-		show_symbol = false;
-	} else if (current_instruction == '\t') {
-		my_strcpy(additional_info, "(tab)", sizeof additional_info);
-		is_empty_character = true;
-		debug_state.instr_has_immediate_effect_in_memory = false;
-		show_symbol = false;
-	} else if (current_instruction == ' ') {
-		my_strcpy(additional_info, "(space)", sizeof additional_info);
-		is_empty_character = true;
-		debug_state.instr_has_immediate_effect_in_memory = false;
-		show_symbol = false;
-	} else if (
-	    current_instruction == '/' || current_instruction == '\\' ||
+	/* Comments and empty characters are stripped by the loader, and the
+	 * instructions of a skipped block are jumped over, so only executed
+	 * instructions get here. */
+	if (current_instruction == '/' || current_instruction == '\\' ||
 	    current_instruction == '$' || current_instruction == ']' ||
 	    current_instruction == '?' || current_instruction == '"' ||
 	    current_instruction == '!' || current_instruction == ';' ||
@@ -923,23 +3637,7 @@ dbg_print_instruction()
 		debug_state.instr_has_immediate_effect_in_memory = false;
 	}
 
-	if (DBG_SKIP_COMMENTS && is_comment) {
-		return;
-	} else if (
-	    DBG_SKIP_NON_EXECUTED_INSTRUCTIONS &&
-	    skip_instruction_because_of_if_else_statement) {
-		return;
-	} else if (DBG_SKIP_EMPTY_CHARACTERS && is_empty_character == true) {
-		return;
-	}
-
-	if (show_symbol) {
-		printf(
-		    "Next instruction: %c%s", current_instruction,
-		    additional_info);
-	} else {
-		printf("Next instruction: %s", additional_info);
-	}
+	printf("Next instruction: %c", current_instruction);
 
 	/* Wait for the user to press "Enter". */
 	getchar();
@@ -956,7 +3654,7 @@ dbg_print_stack_info()
 		printf("\n");
 		dbg_print_n_cells(10);
 
-		if (front_global_cell == NULL) {
+		if (bx_global_queue_length == 0) {
 			printf("(global stack empty)\n");
 		} else {
 			dbg_print_n_global_cells(10);
@@ -967,143 +3665,78 @@ dbg_print_stack_info()
 void
 dbg_print_n_cells(int n)
 {
-	debug_state.dbg_current_cell = first_memory_cell;
-	bool go_ahead;
-	for (int i = 0; i < n; i++) {
-		go_ahead = true;
-		if (i > 0) {
-			go_ahead = false;
-			if (debug_state.dbg_current_cell->next != NULL) {
-				debug_state.dbg_current_cell =
-				    debug_state.dbg_current_cell->next;
-				go_ahead = true;
-			}
-		}
-		if (go_ahead) {
-			if (debug_state.dbg_current_cell == selected_cell) {
-				printf("> ");
-			} else {
-				printf("  ");
-			}
-			printf("Cell #%d: ", i);
-			dbg_print_cell_value(debug_state.dbg_current_cell);
-			printf("\n");
+	for (int i = 0; i < n && i < bx_tape.n_cells; i++) {
+		if (bx_tape.cells + i == selected_cell) {
+			printf("> ");
+		} else {
+			printf("  ");
 		}
+		printf("Cell #%d: ", i);
+		dbg_print_cell_value(bx_tape.cells + i);
+		printf("\n");
 	}
 }
 
 void
 dbg_print_n_global_cells(int n)
 {
-	debug_state.dbg_curr_global_cell = front_global_cell;
-	bool go_ahead;
-	for (int i = 0; i < n; i++) {
-		go_ahead = true;
-		if (i > 0) {
-			go_ahead = false;
-			if (debug_state.dbg_curr_global_cell->next != NULL) {
-				debug_state.dbg_curr_global_cell =
-				    debug_state.dbg_curr_global_cell->next;
-				go_ahead = true;
-			}
-		}
-		if (go_ahead) {
-			if (i == 0 &&
-			    debug_state.dbg_curr_global_cell->next != NULL) {
-				printf("- Global #%d (front): ", i);
-			} else if (
-			    i > 0 &&
-			    debug_state.dbg_curr_global_cell->next == NULL) {
-				printf("- Global #%d (back):  ", i);
-			} else {
-				printf("- Global #%d:         ", i);
-			}
-			dbg_print_global_cell_value(
-			    debug_state.dbg_curr_global_cell);
-			printf("\n");
+	struct TBits *entry;
+	for (int i = 0; i < n && i < bx_global_queue_length; i++) {
+		entry = bx_global_queue + ((bx_global_queue_front + i) &
+					(bx_global_queue_capacity - 1));
+		if (i == 0 && bx_global_queue_length > 1) {
+			printf("- Global #%d (front): ", i);
+		} else if (i > 0 && i == bx_global_queue_length - 1) {
+			printf("- Global #%d (back):  ", i);
+		} else {
+			printf("- Global #%d:         ", i);
 		}
+		dbg_print_global_cell_value(entry);
+		printf("\n");
 	}
 }
 
 void
-dbg_print_cell_value_common(
-    struct TBit *ignored_starting_bit, struct TBit *selected_bit)
+dbg_print_cell_value_common(struct TBits *bits, long long int selected_bit)
 {
-	struct TBit *cur = ignored_starting_bit;
-	struct TBit *last;
-	unsigned int bit_counter = 0;
+	/* "selected_bit" is -1 when there's no selected bit to show. */
+	bool show_selected_null = DBG_SHOW_CURRENT_BITS &&
+				  selected_bit == bits->length;
+	char bit_char;
 
 	char string[255];
+	size_t char_counter = 0;
 	bool too_many_bits = false;
 
-	while (cur->next != NULL) {
-		if (DBG_ONLY_PRINT_BITS_IN_READABLE_ORDER == false) {
-			if (cur->next->value) {
-				if (DBG_SHOW_CURRENT_BITS &&
-				    selected_bit == cur) {
-					printf("[1]");
-				} else {
-					printf("1");
-				}
+	if (DBG_ONLY_PRINT_BITS_IN_READABLE_ORDER == false) {
+		for (long long int i = 0; i < bits->length; i++) {
+			bit_char = get_bit(bits, i) ? '1' : '0';
+			if (DBG_SHOW_CURRENT_BITS && selected_bit == i) {
+				printf("[%c]", bit_char);
 			} else {
-				if (DBG_SHOW_CURRENT_BITS &&
-				    selected_bit == cur) {
-					printf("[0]");
-				} else {
-					printf("0");
-				}
+				printf("%c", bit_char);
 			}
 		}
-		cur = cur->next;
-		bit_counter++;
-	}
-	if (DBG_ONLY_PRINT_BITS_IN_READABLE_ORDER == false) {
-		if (DBG_SHOW_CURRENT_BITS && selected_bit == cur) {
-			printf("[*]");
-		} else {
-			printf("*");
-		}
+		printf(show_selected_null ? "[*]" : "*");
 	}
 
 	/* Reversed (human readable). */
-	unsigned int char_counter = 0;
-
-	last = cur;
-	if (selected_bit != NULL) {
-		if (selected_bit != last) {
-			/* Two brackets. */
-			bit_counter += 2;
+	for (long long int i = bits->length - 1; i >= 0; i--) {
+		/* Leave room for a selected bit and for the terminator. */
+		if (char_counter + 4 >= sizeof string) {
+			too_many_bits = true;
+			break;
 		}
-	}
-	if (bit_counter >= sizeof string) {
-		too_many_bits = true;
-		bit_counter = sizeof string;
-	}
-
-	string[bit_counter] = '\0';
-	while (cur != ignored_starting_bit) {
-		cur = cur->prev;
-		if (cur->next->value == true) {
-			if (too_many_bits == false && DBG_SHOW_CURRENT_BITS &&
-			    selected_bit == cur) {
-				string[char_counter] = '[';
-				string[++char_counter] = '1';
-				string[++char_counter] = ']';
-			} else {
-				string[char_counter] = '1';
-			}
+		bit_char = get_bit(bits, i) ? '1' : '0';
+		if (DBG_SHOW_CURRENT_BITS && selected_bit == i) {
+			string[char_counter++] = '[';
+			string[char_counter++] = bit_char;
+			string[char_counter++] = ']';
 		} else {
-			if (too_many_bits == false && DBG_SHOW_CURRENT_BITS &&
-			    selected_bit == cur) {
-				string[char_counter] = '[';
-				string[++char_counter] = '0';
-				string[++char_counter] = ']';
-			} else {
-				string[char_counter] = '0';
-			}
+			string[char_counter++] = bit_char;
 		}
-		char_counter++;
 	}
+	string[char_counter] = '\0';
 	if (too_many_bits) {
 		/* Print "..." */
 		string[sizeof string - 4] = '.';
@@ -1112,13 +3745,13 @@ dbg_print_cell_value_common(
 		string[sizeof string - 1] = '\0';
 	}
 	if (DBG_ONLY_PRINT_BITS_IN_READABLE_ORDER == false) {
-		if (DBG_SHOW_CURRENT_BITS && selected_bit == last) {
+		if (show_selected_null) {
 			printf("\t([*]%s)", string);
 		} else {
 			printf("\t(*%s)", string);
 		}
 	} else {
-		if (DBG_SHOW_CURRENT_BITS && selected_bit == last) {
+		if (show_selected_null) {
 			printf("[*]%s", string);
 		} else {
 			printf("*%s", string);
@@ -1129,127 +3762,598 @@ dbg_print_cell_value_common(
 void
 dbg_print_cell_value(struct TCell *cell)
 {
-	dbg_print_cell_value_common(
-	    &cell->ignored_starting_bit, cell->selected_bit);
+	dbg_print_cell_value_common(&cell->bits, cell->selected_bit);
 }
 
 void
-dbg_print_global_cell_value(struct TGlobalCell *gl_cell)
+dbg_print_global_cell_value(struct TBits *bits)
 {
-	dbg_print_cell_value_common(&gl_cell->ignored_starting_bit, NULL);
+	dbg_print_cell_value_common(bits, -1);
 }
 
 void
-clear_if_else_statements()
+start_profile()
+{
+	executions = calloc(program_length + 1, sizeof(long long int));
+	skips = calloc(program_length + 1, sizeof(long long int));
+	label_calls = calloc(n_labels + 1, sizeof(long long int));
+
+	/* The main function. */
+	profile_nodes_capacity = 64;
+	profile_nodes =
+	    malloc(profile_nodes_capacity * sizeof(struct TProfileNode));
+	profile_nodes[0] = (struct TProfileNode){-1, -1, -1, -1, 0};
+	n_profile_nodes = 1;
+}
+
+void
+record_source_offset(long long int offset)
 {
-	struct TIfElseStatement *statement_to_delete;
-	while (current_if_else_statement != NULL) {
-		statement_to_delete = current_if_else_statement;
-		current_if_else_statement =
-		    current_if_else_statement->next_nested;
-		free(statement_to_delete);
+	if (program_length == source_offsets_capacity) {
+		source_offsets_capacity = source_offsets_capacity == 0
+					      ? 4096
+					      : source_offsets_capacity * 2;
+		source_offsets = realloc(
+		    source_offsets,
+		    source_offsets_capacity * sizeof(long long int));
 	}
+	source_offsets[program_length] = offset;
+}
+
+/* The listing shows the source as it was read, which may not be there to be
+ * read again, like a pipe. */
+void
+keep_profile_source(const char *source, long long int length)
+{
+	profile_source =
+	    realloc(profile_source, profile_source_length + length);
+	memcpy(profile_source + profile_source_length, source, length);
+	profile_source_length += length;
+}
+
+void
+profile_instruction(long long int pos)
+{
+	executions[pos]++;
+	profile_nodes[profile_node].n_instructions++;
 }
 
 void
-free_local_function_memory()
+profile_call(long long int label)
 {
-	struct TCell *next_cell;
+	long long int node;
 
-	selected_cell = first_memory_cell;
-	while (selected_cell->next != NULL) {
-		next_cell = selected_cell->next;
-		free_cell_content(selected_cell);
-		selected_cell = next_cell;
+	label_calls[label]++;
+	if (profile_depth == PROFILE_MAX_DEPTH) {
+		profile_excess_depth++;
+		return;
 	}
-	selected_cell = NULL;
-	first_memory_cell = NULL;
+	profile_depth++;
+
+	for (node = profile_nodes[profile_node].first_child; node != -1;
+	     node = profile_nodes[node].next_sibling) {
+		if (profile_nodes[node].label == label) {
+			profile_node = node;
+			return;
+		}
+	}
+
+	if (n_profile_nodes == profile_nodes_capacity) {
+		profile_nodes_capacity *= 2;
+		profile_nodes = realloc(
+		    profile_nodes,
+		    profile_nodes_capacity * sizeof(struct TProfileNode));
+	}
+	node = n_profile_nodes++;
+	profile_nodes[node] = (struct TProfileNode){
+	    label, profile_node, -1, profile_nodes[profile_node].first_child,
+	    0};
+	profile_nodes[profile_node].first_child = node;
+	profile_node = node;
 }
 
 void
-free_global_variables()
+profile_return()
 {
-	struct TGlobalCell *current_g_cell;
-	struct TGlobalCell *next_g_cell;
-	struct TLabel *next_label;
+	if (profile_excess_depth > 0) {
+		profile_excess_depth--;
+		return;
+	}
+	profile_depth--;
+	profile_node = profile_nodes[profile_node].parent;
+}
 
-	/* Free the global queue. */
-	if (front_global_cell != NULL) {
-		current_g_cell = front_global_cell;
-		while (current_g_cell->next != NULL) {
-			next_g_cell = current_g_cell->next;
-			free_global_cell_content(current_g_cell);
-			free(current_g_cell);
-			current_g_cell = next_g_cell;
+/* Write the source annotated line by line to "profile_path", followed by the
+ * functions, and the call stacks to "profile_path" with ".folded" appended,
+ * in the format of the flame graph tools. */
+void
+write_profile()
+{
+	FILE *file;
+	char *folded_path;
+	long long int *skipped;
+	long long int *label_lines;
+	long long int target;
+	long long int end;
+	long long int line = 1;
+	long long int offset = 0;
+
+	/* An instruction has been skipped once for every skip from before it
+	 * to at least it; the '!' or ';' a skip ends on isn't run either. */
+	skipped = calloc(program_length + 1, sizeof(long long int));
+	for (long long int pos = 0; pos < program_length; pos++) {
+		target = if_else_jump_table[pos];
+		if (skips[pos] == 0 || target == IF_ELSE_JUMP_TO_ERROR) {
+			continue;
 		}
+		end = target == program_length ? program_length : target + 1;
+		skipped[pos + 1] += skips[pos];
+		skipped[end] -= skips[pos];
+	}
+	for (long long int pos = 1; pos < program_length; pos++) {
+		skipped[pos] += skipped[pos - 1];
 	}
 
-	/* Free registered labels. */
-	if (first_label != NULL) {
-		curr_label = first_label;
-		while (curr_label != NULL) {
-			next_label = curr_label->next;
-			free(curr_label);
-			curr_label = next_label;
+	label_lines = calloc(n_labels + 1, sizeof(long long int));
+	for (long long int i = 0; i < n_labels; i++) {
+		for (; offset < source_offsets[labels[i]]; offset++) {
+			if (profile_source[offset] == '\n') {
+				line++;
+			}
 		}
-		first_label = NULL;
+		label_lines[i] = line;
+	}
+
+	file = fopen(profile_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Can't open the profile file.\n");
+	} else {
+		write_profile_listing(file, skipped, label_lines);
+		fclose(file);
+	}
+
+	folded_path = malloc(strlen(profile_path) + sizeof(".folded"));
+	strcpy(folded_path, profile_path);
+	strcat(folded_path, ".folded");
+	file = fopen(folded_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Can't open the profile file.\n");
+	} else {
+		write_folded_stacks(file, label_lines);
+		fclose(file);
 	}
+
+	free(folded_path);
+	free(label_lines);
+	free(skipped);
 }
 
 void
-free_cell_content(struct TCell *cell)
+write_profile_listing(
+    FILE *file, long long int *skipped, long long int *label_lines)
+{
+	long long int pos = 0;
+	long long int line_start = 0;
+	long long int line_end;
+	long long int line_executions;
+	long long int line_skips;
+	long long int n_instructions;
+	long long int *function_instructions;
+
+	fprintf(
+	    file, "Profile of \"%s\"; how many times the instructions of each "
+		  "line have been\nrun, and skipped by a condition.\n\n",
+	    source_program_path);
+	fprintf(file, "%12s %12s  %s\n", "run", "skipped", "source");
+
+	while (line_start < profile_source_length) {
+		line_end = line_start;
+		while (line_end < profile_source_length &&
+		       profile_source[line_end] != '\n') {
+			line_end++;
+		}
+
+		line_executions = 0;
+		line_skips = 0;
+		n_instructions = 0;
+		for (; pos < program_length && source_offsets[pos] < line_end;
+		     pos++) {
+			line_executions += executions[pos];
+			line_skips += skipped[pos];
+			n_instructions++;
+		}
+
+		if (n_instructions == 0) {
+			fprintf(file, "%12s %12s  ", "-", "-");
+		} else {
+			fprintf(
+			    file, "%12lld %12lld  ", line_executions,
+			    line_skips);
+		}
+		fwrite(
+		    profile_source + line_start, 1, line_end - line_start,
+		    file);
+		fputc('\n', file);
+		line_start = line_end + 1;
+	}
+
+	/* The instructions each function has run itself, wherever it was
+	 * called from. */
+	function_instructions = calloc(n_labels + 1, sizeof(long long int));
+	for (long long int node = 1; node < n_profile_nodes; node++) {
+		function_instructions[profile_nodes[node].label] +=
+		    profile_nodes[node].n_instructions;
+	}
+
+	fprintf(file, "\n%12s %12s  %s\n", "calls", "run", "function");
+	fprintf(
+	    file, "%12s %12lld  main\n", "-", profile_nodes[0].n_instructions);
+	for (long long int i = 0; i < n_labels; i++) {
+		if (label_calls[i] == 0) {
+			continue;
+		}
+		fprintf(
+		    file, "%12lld %12lld  label %lld (line %lld)\n",
+		    label_calls[i], function_instructions[i], i + 1,
+		    label_lines[i]);
+	}
+
+	free(function_instructions);
+}
+
+void
+write_folded_stacks(FILE *file, long long int *label_lines)
 {
-	if (cell->ignored_starting_bit.next != NULL) {
-		cell->selected_bit = cell->ignored_starting_bit.next;
-		while (cell->selected_bit != NULL) {
-			struct TBit *bit_to_delete = cell->selected_bit;
-			cell->selected_bit = cell->selected_bit->next;
-			free(bit_to_delete);
+	for (long long int node = 0; node < n_profile_nodes; node++) {
+		if (profile_nodes[node].n_instructions == 0) {
+			continue;
 		}
+		write_profile_frame(file, node, label_lines);
+		fprintf(file, " %lld\n", profile_nodes[node].n_instructions);
+	}
+}
+
+/* The functions down to "node", from the main one, separated by ';'. */
+void
+write_profile_frame(FILE *file, long long int node, long long int *label_lines)
+{
+	long long int label = profile_nodes[node].label;
+
+	if (label == -1) {
+		fprintf(file, "main");
+		return;
 	}
-	cell->selected_bit = &cell->ignored_starting_bit;
-	cell->selected_bit->next = NULL;
-	cell->selected_bit->prev = NULL;
+	write_profile_frame(file, profile_nodes[node].parent, label_lines);
+	fprintf(
+	    file, ";label %lld (line %lld)", label + 1, label_lines[label]);
 }
 
 void
-free_global_cell_content(struct TGlobalCell *g_cell)
+count_instruction(char instruction)
 {
-	struct TBit *tmp_curr_bit;
+#ifdef USE_STATS
+	if (show_stats) {
+		stats.instructions[(unsigned char)instruction]++;
+	}
+#endif
+}
 
-	if (g_cell->ignored_starting_bit.next != NULL) {
-		tmp_curr_bit = g_cell->ignored_starting_bit.next;
-		while (tmp_curr_bit != NULL) {
-			struct TBit *bit_to_delete = tmp_curr_bit;
-			tmp_curr_bit = tmp_curr_bit->next;
-			free(bit_to_delete);
+void
+count_call()
+{
+#ifdef USE_STATS
+	if (show_stats) {
+		stats.calls++;
+		if (bx_call_depth > stats.max_call_depth) {
+			stats.max_call_depth = bx_call_depth;
 		}
 	}
+#endif
 }
 
 void
-output(struct TCell *cell)
+count_jump()
 {
-	struct TBit *cur = &cell->ignored_starting_bit;
-	unsigned int bit_counter = 0;
-	char character = 0;
-	do {
-		if (cur->next == NULL) {
-			break;
-		} else if (cur->next->value) {
-			character += (char)pow(2, bit_counter);
+#ifdef USE_STATS
+	if (show_stats) {
+		stats.jumps++;
+	}
+#endif
+}
+
+/* The cells of a function only grow, so they're counted when it
+ * terminates. */
+void
+count_cells(long long int n_cells)
+{
+#ifdef USE_STATS
+	if (show_stats && n_cells > stats.max_cells) {
+		stats.max_cells = n_cells;
+	}
+#endif
+}
+
+/* Once the program has terminated; the call stack, and what's still in the
+ * global queue, haven't been freed yet. */
+void
+print_stats()
+{
+#ifdef USE_STATS
+	static const char INSTRUCTIONS[] = "><|+-=_^*%][#&?\"!;:/\\$'@~";
+	struct TMemoryStats *memory = &bx_memory_stats;
+
+	if (show_stats == false) {
+		return;
+	}
+
+	fprintf(stderr, "\nInstructions run:\n");
+	for (int i = 0; INSTRUCTIONS[i] != '\0'; i++) {
+		fprintf(
+		    stderr, "  %-22c%20lld\n", INSTRUCTIONS[i],
+		    stats.instructions[(unsigned char)INSTRUCTIONS[i]]);
+	}
+	fprintf(stderr, "%-24s%20lld\n", "Function calls:", stats.calls);
+	fprintf(stderr, "%-24s%20lld\n", "Jumps:", stats.jumps);
+	fprintf(
+	    stderr, "%-24s%20lld\n", "Bytes allocated:",
+	    memory->allocated_bytes);
+	fprintf(stderr, "%-24s%20lld\n", "Bytes freed:", memory->freed_bytes);
+	fprintf(stderr, "At most, at once:\n");
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "nested calls", stats.max_call_depth);
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "cells of a function", stats.max_cells);
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "bits in the cells",
+	    memory->max_bits_in_cells);
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "bits in the queue",
+	    memory->max_bits_in_queue);
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "values in the queue",
+	    memory->max_queue_length);
+	fprintf(
+	    stderr, "  %-22s%20lld\n", "bytes held", memory->max_held_bytes);
+#endif
+}
+
+void
+clear_if_else_statements()
+{
+	bx_if_else_depth = bx_if_else_base;
+}
+
+void
+free_global_variables()
+{
+	bx_free_global_queue();
+
+	/* Free registered labels. */
+	free(labels);
+	labels = NULL;
+	n_labels = 0;
+	free(label_intrinsics);
+	label_intrinsics = NULL;
+
+	free(program);
+	program = NULL;
+	free(if_else_jump_table);
+	if_else_jump_table = NULL;
+	free(decoded_program);
+	decoded_program = NULL;
+	bx_free_call_stack();
+
+	free(profile_source);
+	profile_source = NULL;
+	free(executions);
+	executions = NULL;
+	free(skips);
+	skips = NULL;
+	free(source_offsets);
+	source_offsets = NULL;
+	free(label_calls);
+	label_calls = NULL;
+	free(profile_nodes);
+	profile_nodes = NULL;
+}
+
+void
+free_cell_content(struct TCell *cell)
+{
+	bx_release_bits(&cell->bits);
+	cell->selected_bit = 0;
+}
+
+bool
+get_bit(struct TBits *bits, long long int index)
+{
+	if (index >= bits->length) {
+		return false;
+	}
+	return bits->buffer->words[index / 64] >> (index % 64) & 1;
+}
+
+struct TCell *
+next_cell(struct TTape *cells, struct TCell *cell, long long int distance)
+{
+	return bx_reach_cell(cells, cell - cells->cells + distance);
+}
+
+void
+go_to_next_bit(struct TCell *cell)
+{
+	if (cell->selected_bit == cell->bits.length) {
+		/* The null bit becomes 0. */
+		bx_extend_bits(&cell->bits, cell->bits.length + 1);
+	}
+	cell->selected_bit++;
+}
+
+void
+set_bit_to_zero(struct TCell *cell)
+{
+	bx_set_bit(cell, false);
+}
+
+void
+set_bit_to_one(struct TCell *cell)
+{
+	bx_set_bit(cell, true);
+}
+
+/* Run the library function at the label "function" natively, with the same
+ * effect on the global queue and on the output; returns the label it leaves
+ * selected, or -1 if it has to be run as written: when running it would end
+ * in an error, or its own calls to the others wouldn't find just its own
+ * values in the queue. */
+long long int
+call_intrinsic(long long int function)
+{
+	switch (label_intrinsics[function]) {
+	case INTRINSIC_ADD:
+		if (bx_call_depth >= bx_max_call_depth ||
+		    bx_global_queue_length < 2) {
+			return -1;
+		}
+		intrinsic_add(false);
+		return function + 1;
+	case INTRINSIC_SUB:
+		/* It calls "normalize" on the queue it leaves. */
+		if (bx_call_depth + 1 >= bx_max_call_depth ||
+		    bx_global_queue_length < 2) {
+			return -1;
+		}
+		intrinsic_add(true);
+		return function + 2 + intrinsic_normalize();
+	case INTRINSIC_NORMALIZE:
+		if (bx_call_depth >= bx_max_call_depth ||
+		    bx_global_queue_length < 1) {
+			return -1;
+		}
+		return function + intrinsic_normalize();
+	case INTRINSIC_SHOW_BINARY:
+		/* It calls "add" and "sub", and "sub" calls "normalize". */
+		if (bx_call_depth + 2 >= bx_max_call_depth ||
+		    bx_global_queue_length != 1) {
+			return -1;
+		}
+		intrinsic_show_binary();
+		return function + 2;
+	}
+	return -1;
+}
+
+/* Replace the first two values of the queue, x and y, with x + y, or with
+ * x - y modulo 2 to the number of bits of the longer one; the null bits count
+ * as 0, and the sum has as many bits as the longer value, plus the carry, if
+ * any. */
+void
+intrinsic_add(bool subtract)
+{
+	struct TCell x = {{NULL, 0}, 0};
+	struct TCell y = {{NULL, 0}, 0};
+	struct TCell result = {{NULL, 0}, 0};
+	long long int length;
+	uint64_t a;
+	uint64_t b;
+	uint64_t word;
+	uint64_t carry = 0;
+
+	bx_dequeue(&x);
+	bx_dequeue(&y);
+	length = x.bits.length > y.bits.length ? x.bits.length
+					       : y.bits.length;
+	bx_reserve_bits(&result.bits, length + 1);
+	result.bits.length = length + 1;
+	for (long long int i = 0; i <= length / 64; i++) {
+		a = get_word(&x.bits, i);
+		b = get_word(&y.bits, i);
+		if (subtract) {
+			word = a - b - carry;
+			carry = a < b || (a == b && carry);
+		} else {
+			word = a + b + carry;
+			carry = word < a || (word == a && carry);
+		}
+		result.bits.buffer->words[i] = word;
+	}
+	if (subtract || get_bit(&result.bits, length) == false) {
+		bx_truncate_bits(&result.bits, length);
+	}
+
+	bx_enqueue(&result);
+	free_cell_content(&x);
+	free_cell_content(&y);
+	free_cell_content(&result);
+}
+
+/* Replace the first value of the queue with itself without the 0 bits after
+ * its last 1, or with a single 0 if it has no 1 at all; returns how many of
+ * its labels "normalize" would have gone through, to leave the empty value,
+ * the 0 or the others. */
+long long int
+intrinsic_normalize()
+{
+	struct TCell x = {{NULL, 0}, 0};
+	long long int labels_passed = 0;
+	long long int length;
+
+	bx_dequeue(&x);
+	if (x.bits.length > 0) {
+		/* From the last word that isn't 0. */
+		length = (x.bits.length + 63) / 64 * 64;
+		while (length > 0 && get_word(&x.bits, length / 64 - 1) == 0) {
+			length -= 64;
+		}
+		while (length > 0 && get_bit(&x.bits, length - 1) == false) {
+			length--;
 		}
-		bit_counter++;
-		if (cur->next != NULL) {
-			cur = cur->next;
+		bx_truncate_bits(&x.bits, length);
+		if (length == 0) {
+			set_bit_to_zero(&x);
+			labels_passed = 1;
+		} else {
+			labels_passed = 2;
 		}
-	} while (bit_counter < 127);
+	}
+
+	bx_enqueue(&x);
+	free_cell_content(&x);
+	return labels_passed;
+}
+
+/* Print the bits of the only value of the queue, the last one first, taking
+ * it away. */
+void
+intrinsic_show_binary()
+{
+	struct TCell x = {{NULL, 0}, 0};
+
+	bx_dequeue(&x);
+	for (long long int i = x.bits.length - 1; i >= 0; i--) {
+		output_character(get_bit(&x.bits, i) ? '1' : '0');
+	}
+	free_cell_content(&x);
+}
+
+/* The word "index" of the bits, 0 past the last one. */
+uint64_t
+get_word(struct TBits *bits, long long int index)
+{
+	if (index >= (bits->length + 63) / 64) {
+		return 0;
+	}
+	return bits->buffer->words[index];
+}
 
+void
+output(struct TCell *cell)
+{
 	if (debug) {
 		printf("OUTPUT: ");
 	}
 
-	printf("%c", character);
+	bx_output(cell);
 
 	if (debug) {
 		printf("\n\n");
@@ -1257,101 +4361,48 @@ output(struct TCell *cell)
 }
 
 void
-input(struct TCell *cell)
+output_character(char character)
 {
-	char n;
-	int remainder;
-	struct TBit *prev_bit;
-
 	if (debug) {
-		printf("INPUT: ");
+		printf("OUTPUT: ");
 	}
 
-	if (scanf("%1c", &n) == 0) {
-		error = ERR_USER_INPUT;
-		return;
-	}
+	bx_output_character(character);
 
 	if (debug) {
-		/* Avoid immediately triggering the next print. */
-		getchar();
-
-		printf("\n");
+		printf("\n\n");
 	}
-
-	do {
-		remainder = n % 2;
-		prev_bit = cell->selected_bit;
-		struct TBit *newBit = malloc(sizeof(struct TBit));
-		cell->selected_bit->next = newBit;
-		cell->selected_bit = cell->selected_bit->next;
-		cell->selected_bit->value = remainder;
-		cell->selected_bit->next = NULL;
-		cell->selected_bit->prev = prev_bit;
-		n /= 2;
-		if (cell->selected_bit->next != NULL) {
-			cell->selected_bit = cell->selected_bit->next;
-		}
-	} while (n != 0);
-	cell->selected_bit = &cell->ignored_starting_bit;
 }
 
 void
-process_errors()
+input(struct TCell *cell)
 {
-	if (error) {
-		fprintf(
-		    stderr,
-		    "\nThe program has been terminated due to an error:\n  ");
-		switch (error) {
-		case ERR_STRING_TOO_LONG:
-			fprintf(stderr, "buffer overflow in some string");
-			break;
-		case ERR_MISPLACED_ELSE:
-			fprintf(stderr, "misplaced else statement");
-			break;
-		case ERR_END_IF:
-			fprintf(
-			    stderr,
-			    "unexpected end of IF condition or else statement");
-			break;
-		case ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS:
-			fprintf(
-			    stderr, "label pointer moved outside of bounds");
-			break;
-		case ERR_JUMP_BUT_NO_LABEL:
-			fprintf(
-			    stderr, "call or jump to a label, but there is "
-				    "no label at all");
-			break;
-		case ERR_SEEK_PROGRAM_POSITION:
-			fprintf(
-			    stderr, "can't read from the requested "
-				    "position after a jump or "
-				    "function call");
-			break;
-		case ERR_EMPTY_GLOBAL_STACK:
-			fprintf(
-			    stderr, "tried to pop from the global stack "
-				    "but it's empty");
-			break;
-		case ERR_USER_INPUT:
-			fprintf(stderr, "bad input");
-			break;
-		default:
-			fprintf(stderr, "unknown error");
+	/* Whatever the program asks, the user gets to see it first. */
+	bx_flush_output();
+
+	if (debug) {
+		printf("INPUT: ");
+		fflush(stdout);
+	}
+
+	bx_input(cell);
+
+	if (debug) {
+		/* At the end of the input the cell is left with all its bits
+		 * null, which no character does. */
+		if (cell->bits.length > 0 && input_path == NULL) {
+			/* Avoid immediately triggering the next print. */
+			getchar();
 		}
-		printf(".\n");
 
-		/* Prevent multiple prints. */
-		error = OK;
+		printf("\n");
 	}
 }
 
 int
 main(int argc, char *argv[])
 {
-	FILE *source_program;
+	int source_program;
 
 	if (process_arguments(argc, argv) != 0) {
 		return 1;
@@ -1360,47 +4411,99 @@ main(int argc, char *argv[])
 	if (show_usage) {
 		printf("Usage: boolx [options] source_file\n");
 		printf("\nBoolX official interpreter; v1.0.\n");
-		printf("\n  -d                    run the interpreter in "
+		printf("\n  -a                    write the output from a "
+		       "thread of its own\n");
+		printf("  -c                    print the program translated "
+		       "to C instead of\n"
+		       "                          running it\n");
+		printf("  -d                    run the interpreter in "
 		       "debug mode\n");
+		printf("  -i FILE               read the input of the program "
+		       "from FILE\n");
+		printf("  -j                    compile the program to x86-64 "
+		       "machine code before\n"
+		       "                          running it\n");
+		printf(
+		    "  -m N                  allow at most N nested function "
+		    "calls\n"
+		    "                          (default is %d)\n",
+		    MAX_CALL_DEPTH_DEFAULT);
+		printf("  -n                    run the functions of the "
+		       "library as they're written,\n"
+		       "                          not natively\n");
+		printf("  -o FILE               write the output of the "
+		       "program to FILE\n");
+		printf("  -p FILE               count how many times each "
+		       "instruction runs, and write\n"
+		       "                          the counts to FILE and the "
+		       "call stacks to\n"
+		       "                          FILE.folded (runs the "
+		       "reference loop)\n");
+		printf("  -r                    run the reference loop instead "
+		       "of the threaded\n"
+		       "                          engine (always the case in "
+		       "debug mode)\n");
+		printf("  -s                    print what the program has "
+		       "done and the most memory\n"
+		       "                          it has taken when it "
+		       "terminates (runs the\n"
+		       "                          reference loop)\n");
 		return 0;
 	}
 
-	source_program = fopen(source_program_path, "r");
-	if (source_program == NULL) {
+	source_program = open(source_program_path, O_RDONLY);
+	if (source_program < 0) {
 		fprintf(stderr, "Can't open the source program file.\n");
 		return 1;
 	} else {
-		front_global_cell = NULL;
-		back_global_cell = NULL;
-
-		first_label = NULL;
-		curr_label = NULL;
-
-		register_all_labels(source_program);
-		curr_label = first_label;
+		load_source_program(source_program);
+		close(source_program);
 
-		process_errors();
-		if (error != OK) {
+		if (bx_error != OK) {
+			bx_process_errors();
+			bx_flush_output();
 			free_global_variables();
 			return 1;
+		} else if (emit_c) {
+			emit_c_program();
 		} else {
+			bx_unbuffered_output = debug;
+			bx_input_through_stdio = debug && input_path == NULL;
+			if (open_input_and_output() == false) {
+				free_global_variables();
+				return 1;
+			}
+			bx_start_output_writer();
+
 			dbg_print_labels();
 
-			/* Start the main function of the source program. */
-			execute_source_program_function(source_program, 0);
+			if (profile_path != NULL) {
+				start_profile();
+				execute_source_program();
+				write_profile();
+			} else if (debug || use_reference_loop || show_stats) {
+				execute_source_program();
+			} else if (use_jit) {
+				execute_compiled_program();
+			} else {
+				execute_decoded_program();
+			}
 
 			if (PRINT_NEW_LINE_AFTER_TERMINATION) {
-				printf("\n");
+				bx_buffer_output("\n", 1);
 			}
+			bx_flush_output();
+			bx_stop_output_writer();
+			close_input_and_output();
+			print_stats();
 		}
 
 		free_global_variables();
 
-		if (error != OK) {
+		if (fatal_error) {
 			return 1;
 		} else {
 			return 0;
 		}
 	}
-	fclose(source_program);
 }
@@ -0,0 +1,170 @@
+/*
+ * runtime.c
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+#include "runtime.h"
+
+#include <stdio.h>  // fprintf
+#include <stdlib.h> // exit, strtoll
+#include <string.h> // strcmp
+
+long long int bx_label = 0;
+long long int bx_return_pos = 0;
+
+static long long int n_labels = 0;
+/* Set by errors that terminate the whole program instead of the function. */
+static bool fatal_error = false;
+
+/* Start the main function of a program with "labels" labels and if-else
+ * statements nested at most "max_depth" deep; the program accepts the "-m N"
+ * option of the interpreter. */
+struct TCell *
+bx_start(int argc, char *argv[], long long int labels, long long int max_depth)
+{
+	char *end;
+
+	if (argc == 3 && strcmp(argv[1], "-m") == 0) {
+		bx_max_call_depth = strtoll(argv[2], &end, 10);
+		if (*end != '\0' || end == argv[2] || bx_max_call_depth < 0) {
+			fprintf(
+			    stderr,
+			    "Option '-m' has been given a bad value.\n");
+			exit(1);
+		}
+	} else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [-m N]\n", argv[0]);
+		exit(1);
+	}
+
+	n_labels = labels;
+	bx_if_else_max_depth = max_depth;
+	bx_enter_function();
+	return bx_tape.cells;
+}
+
+/* Free everything once the main function has terminated; returns the exit
+ * status of the program. */
+int
+bx_finish()
+{
+	if (PRINT_NEW_LINE_AFTER_TERMINATION) {
+		bx_buffer_output("\n", 1);
+	}
+	bx_flush_output();
+
+	bx_free_global_queue();
+	bx_free_call_stack();
+
+	return fatal_error ? 1 : 0;
+}
+
+/* Visit the cells up to "offset" cells after "*cell", which is moved along
+ * with them; returns that cell. */
+struct TCell *
+bx_grow(struct TCell **cell, long long int offset)
+{
+	long long int n = *cell - bx_tape.cells;
+	struct TCell *target_cell = bx_reach_cell(&bx_tape, n + offset);
+
+	*cell = bx_tape.cells + n;
+	return target_cell;
+}
+
+bool
+bx_next_label(long long int distance)
+{
+	if (bx_label + distance >= n_labels) {
+		/* It stops on the last label. */
+		if (n_labels > 0) {
+			bx_label = n_labels - 1;
+		}
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+		return false;
+	}
+	bx_label += distance;
+	return true;
+}
+
+bool
+bx_previous_label(long long int distance)
+{
+	if (bx_label < distance) {
+		/* It stops on the first label. */
+		bx_label = 0;
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+		return false;
+	}
+	bx_label -= distance;
+	return true;
+}
+
+bool
+bx_first_label()
+{
+	if (n_labels == 0) {
+		bx_error = ERR_LABEL_CURSOR_OUTSIDE_OF_BOUNDS;
+		return false;
+	}
+	bx_label = 0;
+	return true;
+}
+
+/* For jumps and calls to the selected label. */
+bool
+bx_has_labels()
+{
+	if (n_labels == 0) {
+		bx_error = ERR_JUMP_BUT_NO_LABEL;
+		return false;
+	}
+	return true;
+}
+
+/* Push the running function, whose selected cell is "cell", on the call stack
+ * and start a new one; returns its selected cell, or NULL if there are too
+ * many nested calls. */
+struct TCell *
+bx_call(struct TCell *cell, long long int return_pos)
+{
+	if (bx_call_depth == bx_max_call_depth) {
+		bx_error = ERR_CALL_STACK_OVERFLOW;
+		fatal_error = true;
+		return NULL;
+	}
+
+	bx_save_caller(return_pos, cell);
+	bx_enter_function();
+	return bx_tape.cells;
+}
+
+/* Terminate the running function; returns the selected cell of its caller,
+ * which goes on from "bx_return_pos", or NULL if it was the main one. */
+struct TCell *
+bx_return()
+{
+	struct TFrame *caller = bx_leave_function();
+
+	if (caller == NULL) {
+		return NULL;
+	}
+	bx_return_pos = caller->return_pos;
+	return bx_tape.cells + caller->index_of_the_selected_cell;
+}
+
+/* Terminate the running function because of "bx_error", or all of them if
+ * it's fatal; returns as "bx_return". */
+struct TCell *
+bx_fail()
+{
+	struct TCell *cell;
+
+	bx_process_errors();
+	do {
+		cell = bx_return();
+	} while (cell != NULL && fatal_error);
+	return cell;
+}
@@ -0,0 +1,139 @@
+/*
+ * runtime.h
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+/* What the C translations of BoolX programs, made with "boolx -c", run on;
+ * they're compiled together with "runtime.c" and "core.c". The memory is the
+ * one of the interpreter, from "core.h", and so is the state of the running
+ * function, except for the selected cell, that the program keeps itself and
+ * hands to the functions that need it. */
+
+#ifndef BOOLX_RUNTIME_H
+#define BOOLX_RUNTIME_H
+
+#include "core.h"
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // NULL
+#include <stdint.h>  // uint64_t
+
+extern long long int bx_label;
+/* Where the function that has just returned had been called from. */
+extern long long int bx_return_pos;
+
+struct TCell *bx_start(
+    int argc, char *argv[], long long int labels, long long int max_depth);
+int bx_finish();
+struct TCell *bx_grow(struct TCell **cell, long long int offset);
+bool bx_next_label(long long int distance);
+bool bx_previous_label(long long int distance);
+bool bx_first_label();
+bool bx_has_labels();
+struct TCell *bx_call(struct TCell *cell, long long int return_pos);
+struct TCell *bx_return();
+struct TCell *bx_fail();
+
+/* The cell "offset" cells after "*cell"; it may move the cells, and
+ * "*cell" with them. */
+static inline struct TCell *
+bx_target_cell(struct TCell **cell, long long int offset)
+{
+	if (*cell - bx_tape.cells + offset < bx_tape.n_cells) {
+		return *cell + offset;
+	}
+	return bx_grow(cell, offset);
+}
+
+static inline struct TCell *
+bx_next_cell(struct TCell *cell, long long int distance)
+{
+	return bx_target_cell(&cell, distance);
+}
+
+static inline struct TCell *
+bx_previous_cell(struct TCell *cell, long long int distance)
+{
+	if (cell - bx_tape.cells > distance) {
+		return cell - distance;
+	}
+	return bx_tape.cells;
+}
+
+/* Moves forward by "distance" bits, the farthest one being "reach" bits
+ * away; the null bits passed over become 0. */
+static inline void
+bx_next_bit(struct TCell *cell, long long int distance, long long int reach)
+{
+	if (cell->selected_bit + reach > cell->bits.length) {
+		bx_extend_bits(&cell->bits, cell->selected_bit + reach);
+	}
+	cell->selected_bit += distance;
+}
+
+static inline void
+bx_previous_bit(struct TCell *cell, long long int distance)
+{
+	if (cell->selected_bit > distance) {
+		cell->selected_bit -= distance;
+	} else {
+		cell->selected_bit = 0;
+	}
+}
+
+static inline bool
+bx_is_null(struct TCell *cell)
+{
+	return cell->selected_bit >= cell->bits.length;
+}
+
+static inline bool
+bx_is_one(struct TCell *cell)
+{
+	long long int i = cell->selected_bit;
+
+	return bx_is_null(cell) == false &&
+	       (cell->bits.buffer->words[i / 64] >> (i % 64) & 1);
+}
+
+static inline void
+bx_set_bit_to_zero(struct TCell *cell)
+{
+	long long int i = cell->selected_bit;
+
+	if (i < cell->bits.length && cell->bits.buffer->n_references == 1) {
+		cell->bits.buffer->words[i / 64] &= ~((uint64_t)1 << (i % 64));
+	} else {
+		bx_set_bit(cell, false);
+	}
+}
+
+static inline void
+bx_set_bit_to_one(struct TCell *cell)
+{
+	long long int i = cell->selected_bit;
+
+	if (i < cell->bits.length && cell->bits.buffer->n_references == 1) {
+		cell->bits.buffer->words[i / 64] |= (uint64_t)1 << (i % 64);
+	} else {
+		bx_set_bit(cell, true);
+	}
+}
+
+static inline void
+bx_set_bit_to_null(struct TCell *cell)
+{
+	bx_truncate_bits(&cell->bits, cell->selected_bit);
+}
+
+static inline void
+bx_set_all_bits_to_null(struct TCell *cell)
+{
+	cell->selected_bit = 0;
+	bx_truncate_bits(&cell->bits, 0);
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * tokenizer.c
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+#include "tokenizer.h"
+
+/* On x86-64 the blocks are classified 16 or 32 characters at a time, with
+ * SSSE3 or AVX2 if the processor has them; compile with -DNO_SIMD to always
+ * classify them one character at a time. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_SIMD)
+#define USE_SIMD
+#include <immintrin.h> // _mm_shuffle_epi8, _mm256_shuffle_epi8
+#endif
+
+enum character_classes {
+	INSTRUCTION = 1,
+	LABEL = 2,
+	COMMENT_START = 4,
+	COMMENT_END = 8
+};
+
+static void tokenize_block_by_character(
+    const char *block, long long int length, struct TTokens *tokens);
+#ifdef USE_SIMD
+static void tokenize_block_with_ssse3(
+    const char *block, struct TTokens *tokens);
+static void tokenize_block_with_avx2(const char *block, struct TTokens *tokens);
+#endif
+
+static const unsigned char CHARACTER_CLASSES[256] = {
+    ['>'] = INSTRUCTION, ['<'] = INSTRUCTION,  ['|'] = INSTRUCTION,
+    ['+'] = INSTRUCTION, ['-'] = INSTRUCTION,  ['='] = INSTRUCTION,
+    ['_'] = INSTRUCTION, ['^'] = INSTRUCTION,  ['*'] = INSTRUCTION,
+    ['%'] = INSTRUCTION, [']'] = INSTRUCTION,  ['['] = INSTRUCTION,
+    ['#'] = INSTRUCTION, ['&'] = INSTRUCTION,  ['?'] = INSTRUCTION,
+    ['"'] = INSTRUCTION, ['!'] = INSTRUCTION,  [';'] = INSTRUCTION,
+    ['/'] = INSTRUCTION, ['\\'] = INSTRUCTION, ['$'] = INSTRUCTION,
+    ['\''] = INSTRUCTION, ['@'] = INSTRUCTION, ['~'] = INSTRUCTION,
+    [':'] = INSTRUCTION | LABEL, ['{'] = COMMENT_START,
+    ['}'] = COMMENT_END};
+
+#ifdef USE_SIMD
+/* The instructions are looked up by the two halves of their code, each one
+ * shuffling a table: HIGH_HALVES gives every high half that instructions have
+ * a bit of its own (0x20 to 0x2F the first one, and so on), and LOW_HALVES
+ * gives, for every low half, the bits of the high halves that together with
+ * it make an instruction. A character is an instruction when the two have a
+ * bit in common. */
+static const char HIGH_HALVES[16] = {0x00, 0x00, 0x01, 0x02, 0x04, 0x08,
+				     0x00, 0x10, 0x00, 0x00, 0x00, 0x00,
+				     0x00, 0x00, 0x00, 0x00};
+static const char LOW_HALVES[16] = {0x04, 0x01, 0x01, 0x01, 0x01, 0x01,
+				    0x01, 0x01, 0x00, 0x00, 0x03, 0x0B,
+				    0x1A, 0x0B, 0x1A, 0x0B};
+#endif
+
+void
+tokenize_block(const char *block, long long int length, struct TTokens *tokens)
+{
+#ifdef USE_SIMD
+	if (length == TOKENIZER_BLOCK_SIZE) {
+		if (__builtin_cpu_supports("avx2")) {
+			tokenize_block_with_avx2(block, tokens);
+			return;
+		} else if (__builtin_cpu_supports("ssse3")) {
+			tokenize_block_with_ssse3(block, tokens);
+			return;
+		}
+	}
+#endif
+	tokenize_block_by_character(block, length, tokens);
+}
+
+void
+tokenize_block_by_character(
+    const char *block, long long int length, struct TTokens *tokens)
+{
+	unsigned char character_class;
+
+	tokens->instructions = 0;
+	tokens->labels = 0;
+	tokens->comment_starts = 0;
+	tokens->comment_ends = 0;
+	for (long long int i = 0; i < length; i++) {
+		character_class = CHARACTER_CLASSES[(unsigned char)block[i]];
+		tokens->instructions |=
+		    (uint64_t)(character_class & INSTRUCTION) << i;
+		tokens->labels |= (uint64_t)(character_class >> 1 & 1) << i;
+		tokens->comment_starts |= (uint64_t)(character_class >> 2 & 1)
+					  << i;
+		tokens->comment_ends |= (uint64_t)(character_class >> 3 & 1)
+					<< i;
+	}
+}
+
+#ifdef USE_SIMD
+__attribute__((target("ssse3"))) void
+tokenize_block_with_ssse3(const char *block, struct TTokens *tokens)
+{
+	const __m128i high_halves =
+	    _mm_loadu_si128((const __m128i *)HIGH_HALVES);
+	const __m128i low_halves = _mm_loadu_si128((const __m128i *)LOW_HALVES);
+	const __m128i half_mask = _mm_set1_epi8(0x0F);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i characters;
+	__m128i classes;
+	uint64_t instructions;
+
+	tokens->instructions = 0;
+	tokens->labels = 0;
+	tokens->comment_starts = 0;
+	tokens->comment_ends = 0;
+	for (int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 16) {
+		characters = _mm_loadu_si128((const __m128i *)(block + i));
+		classes = _mm_and_si128(
+		    _mm_shuffle_epi8(
+			high_halves,
+			_mm_and_si128(
+			    _mm_srli_epi16(characters, 4), half_mask)),
+		    _mm_shuffle_epi8(
+			low_halves, _mm_and_si128(characters, half_mask)));
+
+		/* The characters from 0x80 on have no high half in the table,
+		 * so they're never instructions. */
+		instructions = (uint16_t)~_mm_movemask_epi8(
+		    _mm_cmpeq_epi8(classes, zero));
+		tokens->instructions |= instructions << i;
+		tokens->labels |=
+		    (uint64_t)(uint16_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8(':')))
+		    << i;
+		tokens->comment_starts |=
+		    (uint64_t)(uint16_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8('{')))
+		    << i;
+		tokens->comment_ends |=
+		    (uint64_t)(uint16_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(characters, _mm_set1_epi8('}')))
+		    << i;
+	}
+}
+
+/* Same as "tokenize_block_with_ssse3", 32 characters at a time; the shuffles
+ * work on the two halves of the registers separately, so the tables are in
+ * both. */
+__attribute__((target("avx2"))) void
+tokenize_block_with_avx2(const char *block, struct TTokens *tokens)
+{
+	const __m256i high_halves = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)HIGH_HALVES));
+	const __m256i low_halves = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)LOW_HALVES));
+	const __m256i half_mask = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i characters;
+	__m256i classes;
+	uint64_t instructions;
+
+	tokens->instructions = 0;
+	tokens->labels = 0;
+	tokens->comment_starts = 0;
+	tokens->comment_ends = 0;
+	for (int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 32) {
+		characters = _mm256_loadu_si256((const __m256i *)(block + i));
+		classes = _mm256_and_si256(
+		    _mm256_shuffle_epi8(
+			high_halves,
+			_mm256_and_si256(
+			    _mm256_srli_epi16(characters, 4), half_mask)),
+		    _mm256_shuffle_epi8(
+			low_halves, _mm256_and_si256(characters, half_mask)));
+
+		instructions = (uint32_t)~_mm256_movemask_epi8(
+		    _mm256_cmpeq_epi8(classes, zero));
+		tokens->instructions |= instructions << i;
+		tokens->labels |=
+		    (uint64_t)(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8(':')))
+		    << i;
+		tokens->comment_starts |=
+		    (uint64_t)(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('{')))
+		    << i;
+		tokens->comment_ends |=
+		    (uint64_t)(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(characters, _mm256_set1_epi8('}')))
+		    << i;
+	}
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+ * tokenizer.h
+ *
+ * This file is part of "BoolX"
+ * Copyright (c) 2021 Andrea Calligaris
+ * Distributed under the MIT License, see "license.txt"
+ */
+
+/* What the interpreter and the compactor read source programs with; they're
+ * compiled together with "tokenizer.c". A source is classified a block of
+ * characters at a time, into one mask per kind of character, where bit "i" is
+ * about the character "i" of the block. */
+
+#ifndef BOOLX_TOKENIZER_H
+#define BOOLX_TOKENIZER_H
+
+#include <stdint.h> // uint64_t
+
+#define TOKENIZER_BLOCK_SIZE 64
+
+struct TTokens {
+	/* Every instruction, ":" included. */
+	uint64_t instructions;
+	uint64_t labels;
+	uint64_t comment_starts;
+	uint64_t comment_ends;
+};
+
+/* Classify the "length" characters at "block", at most
+ * TOKENIZER_BLOCK_SIZE. */
+void tokenize_block(
+    const char *block, long long int length, struct TTokens *tokens);
+
+/* The position of the first set bit of "*mask", which is then cleared; the
+ * mask mustn't be 0. */
+static inline int
+next_token(uint64_t *mask)
+{
+	int i = 0;
+
+#ifdef __GNUC__
+	i = __builtin_ctzll(*mask);
+#else
+	while ((*mask >> i & 1) == 0) {
+		i++;
+	}
+#endif
+	*mask &= *mask - 1;
+	return i;
+}
+
+static inline long long int
+count_tokens(uint64_t mask)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(mask);
+#else
+	long long int n = 0;
+
+	for (; mask != 0; mask &= mask - 1) {
+		n++;
+	}
+	return n;
+#endif
+}
+
+#endif